@@ -1,4 +1,183 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE // madvise
+
 #include "AVL.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef AVL_TRACE
+#include <signal.h>
+#endif
+
+#if defined(AVL_LATENCY_RDTSC) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#endif
+
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define AVL_THREAD_LOCAL _Thread_local
+#elif defined(__GNUC__)
+#define AVL_THREAD_LOCAL __thread
+#else
+#define AVL_THREAD_LOCAL
+#endif
+
+// instrumentation hooks: compile to nothing unless AVL_STATS is defined
+#ifdef AVL_STATS
+static AVLOpStats opStats;
+static unsigned long long opDepth; // nodes visited by the current operation
+
+static void recordDepth(AVLOpType op)
+{
+    AVLDepthStats *d = &opStats.depth[op];
+    d->count++;
+    d->totalDepth += opDepth;
+    if (opDepth > d->maxDepth)
+        d->maxDepth = opDepth;
+}
+
+#define AVL_STAT_INC(field) (opStats.field++)
+#define AVL_COMPARE(compare, a, b) (opStats.comparisons++, (compare)(a, b))
+#define AVL_STAT_VISIT() (opDepth++)
+#define AVL_DEPTH_BEGIN() (opDepth = 0)
+#define AVL_DEPTH_END(op) recordDepth(op)
+#else
+#define AVL_STAT_INC(field) ((void)0)
+#define AVL_COMPARE(compare, a, b) ((compare)(a, b))
+#define AVL_STAT_VISIT() ((void)0)
+#define AVL_DEPTH_BEGIN() ((void)0)
+#define AVL_DEPTH_END(op) ((void)0)
+#endif
+
+// latency hooks: compile to nothing unless AVL_LATENCY is defined
+#ifdef AVL_LATENCY
+static AVL_THREAD_LOCAL AVLLatencyRecorder *latencyRecorder;
+
+#define AVL_LATENCY_BEGIN() unsigned long long opStart = latencyRecorder ? latencyClock() : 0
+#define AVL_LATENCY_END(op)                                                       \
+    do                                                                            \
+    {                                                                             \
+        if (latencyRecorder)                                                      \
+            histogramRecord(&latencyRecorder->ops[op], latencyClock() - opStart); \
+    } while (0)
+#else
+#define AVL_LATENCY_BEGIN() ((void)0)
+#define AVL_LATENCY_END(op) ((void)0)
+#endif
+
+// trace hooks: compile to nothing unless AVL_TRACE is defined
+#ifdef AVL_TRACE
+#ifndef __GNUC__
+#error "AVL_TRACE needs the GCC/Clang __atomic builtins"
+#endif
+
+// events of one thread; only the owner writes, readers validate each slot's seq
+typedef struct AVLTraceBuffer
+{
+    AVLTraceEvent events[AVL_TRACE_CAPACITY];
+    unsigned long long head;     // events written so far
+    unsigned int thread;         // registration order, shown in dumps
+    struct AVLTraceBuffer *next; // buffers are never freed, so dumps include exited threads
+} AVLTraceBuffer;
+
+static AVLTraceBuffer *traceBuffers;
+static unsigned int traceThreads;
+static hash_func_t traceKeyHash;
+static AVL_THREAD_LOCAL AVLTraceBuffer *traceBuffer;
+static AVL_THREAD_LOCAL unsigned int traceDepth, traceRotations;
+
+// allocate the calling thread's buffer and push it onto the global list
+static AVLTraceBuffer *traceAttach(void)
+{
+    AVLTraceBuffer *buf = calloc(1, sizeof(*buf));
+    if (!buf)
+        return NULL;
+
+    buf->thread = __atomic_fetch_add(&traceThreads, 1, __ATOMIC_RELAXED);
+    buf->next = __atomic_load_n(&traceBuffers, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&traceBuffers, &buf->next, buf, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        ;
+    traceBuffer = buf;
+    return buf;
+}
+
+// hash of the operation's key (the data pointer is mixed when no hash is set)
+static unsigned long long traceHash(const void *data)
+{
+    hash_func_t hash = __atomic_load_n(&traceKeyHash, __ATOMIC_RELAXED);
+    if (hash)
+        return hash(data);
+
+    unsigned long long h = (unsigned long long)(uintptr_t)data;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    return h ^ (h >> 33);
+}
+
+static void traceRecord(AVLOpType op, const void *key, unsigned long long start)
+{
+    unsigned long long duration = latencyClock() - start;
+    AVLTraceBuffer *buf = traceBuffer ? traceBuffer : traceAttach();
+    if (!buf)
+        return;
+
+    unsigned long long seq = buf->head + 1;
+    AVLTraceEvent *e = &buf->events[buf->head & (AVL_TRACE_CAPACITY - 1)];
+
+    // clear seq first so a reader never accepts a half-written slot
+    __atomic_store_n(&e->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    e->timestamp = start;
+    e->duration = duration;
+    e->keyHash = key ? traceHash(key) : 0;
+    e->depth = traceDepth;
+    e->rotations = (unsigned short)traceRotations;
+    e->op = (unsigned char)op;
+    __atomic_store_n(&e->seq, seq, __ATOMIC_RELEASE);
+    __atomic_store_n(&buf->head, seq, __ATOMIC_RELEASE);
+}
+
+#define AVL_TRACE_VISIT() (traceDepth++)
+#define AVL_TRACE_ROTATIONS(n) (traceRotations += (n))
+#define AVL_TRACE_BEGIN() unsigned long long traceStart = (traceDepth = traceRotations = 0, latencyClock())
+#define AVL_TRACE_END(op, key) traceRecord(op, key, traceStart)
+#else
+#define AVL_TRACE_VISIT() ((void)0)
+#define AVL_TRACE_ROTATIONS(n) ((void)0)
+#define AVL_TRACE_BEGIN() ((void)0)
+#define AVL_TRACE_END(op, key) ((void)0)
+#endif
+
+#define AVL_VISIT() (AVL_STAT_VISIT(), AVL_TRACE_VISIT())
+#define AVL_SINGLE_ROTATION() (AVL_STAT_INC(singleRotations), AVL_TRACE_ROTATIONS(1))
+#define AVL_DOUBLE_ROTATION() (AVL_STAT_INC(doubleRotations), AVL_TRACE_ROTATIONS(2))
+
+// bracket one public operation
+#define AVL_OP_BEGIN()   \
+    AVL_DEPTH_BEGIN();   \
+    AVL_LATENCY_BEGIN(); \
+    AVL_TRACE_BEGIN()
+#define AVL_OP_END(op, key) \
+    AVL_DEPTH_END(op);      \
+    AVL_LATENCY_END(op);    \
+    AVL_TRACE_END(op, key)
+
+// keep parent links in sync when a child pointer changes
+#ifdef AVL_PARENT_POINTERS
+#define AVL_SET_PARENT(child, p)       \
+    do                                 \
+    {                                  \
+        if (child)                     \
+            (child)->parent = (p);     \
+    } while (0)
+#else
+#define AVL_SET_PARENT(child, p) ((void)0)
+#endif
 
 // get node height
 int getHeight(const AVLNode *node)
@@ -7,11 +186,27 @@ int getHeight(const AVLNode *node)
 }
 
 // get node size (number of nodes in subtree)
-int getSize(const AVLNode *node)
+avl_size_t getSize(const AVLNode *node)
 {
     return node ? node->size : 0;
 }
 
+// get live node count (nodes in subtree that are not tombstones)
+avl_size_t getLiveSize(const AVLNode *node)
+{
+#ifdef AVL_TOMBSTONES
+    return node ? node->live : 0;
+#else
+    return getSize(node);
+#endif
+}
+
+// false for a tombstone; always true without -DAVL_TOMBSTONES
+static bool isLive(const AVLNode *node)
+{
+    return !(node->flags & AVL_NODE_DELETED);
+}
+
 // get balance factor
 int getBalance(const AVLNode *node)
 {
@@ -32,12 +227,210 @@ void updateSize(AVLNode *node)
     if (!node)
         return;
     node->size = 1 + getSize(node->left) + getSize(node->right);
+#ifdef AVL_TOMBSTONES
+    node->live = isLive(node) + getLiveSize(node->left) + getLiveSize(node->right);
+#endif
+}
+
+#ifdef AVL_NODE_ARENA
+// how an arena chunk was obtained, from most to least preferred
+enum
+{
+    AVL_CHUNK_HUGETLB,
+    AVL_CHUNK_MMAP,
+    AVL_CHUNK_MALLOC
+};
+
+typedef struct AVLArenaChunk
+{
+    char *base;
+    size_t bytes;
+    int backing; // AVL_CHUNK_*
+} AVLArenaChunk;
+
+// one process-wide arena: nodes are bump-allocated from the newest chunk and released
+// nodes are reused first, linked through their left pointer
+static AVLArenaChunk *arenaChunks;
+static size_t arenaChunkCount;
+static size_t arenaChunkCapacity;
+static char *arenaNext; // unused tail of the newest chunk
+static char *arenaEnd;
+static AVLNode *arenaFreeList;
+static size_t arenaNodesInUse;
+static size_t arenaNodesFree;
+static bool arenaNoHugetlb; // an explicit huge page mapping failed; don't retry
+static pthread_mutex_t arenaLock = PTHREAD_MUTEX_INITIALIZER;
+
+// map a chunk: explicit huge pages if the system has them reserved, else memory aligned
+// to a huge page and advised for transparent huge pages, else plain malloc
+static char *arenaMapChunk(size_t bytes, int *backing)
+{
+    void *memory;
+#ifdef MAP_HUGETLB
+    if (!arenaNoHugetlb)
+    {
+        memory = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (memory != MAP_FAILED)
+        {
+            *backing = AVL_CHUNK_HUGETLB;
+            return memory;
+        }
+        arenaNoHugetlb = true;
+    }
+#endif
+
+    // over-map by one huge page and trim both ends to get an aligned chunk
+    size_t span = bytes + AVL_HUGE_PAGE_SIZE;
+    memory = mmap(NULL, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory != MAP_FAILED)
+    {
+        uintptr_t start = (uintptr_t)memory;
+        uintptr_t aligned = (start + AVL_HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(AVL_HUGE_PAGE_SIZE - 1);
+        if (aligned > start)
+            munmap(memory, aligned - start);
+        if (start + span > aligned + bytes)
+            munmap((void *)(aligned + bytes), start + span - (aligned + bytes));
+#ifdef MADV_HUGEPAGE
+        madvise((void *)aligned, bytes, MADV_HUGEPAGE);
+#endif
+        *backing = AVL_CHUNK_MMAP;
+        return (char *)aligned;
+    }
+
+    *backing = AVL_CHUNK_MALLOC;
+    return malloc(bytes);
+}
+
+// add a chunk to the arena and make it the one nodes are carved from
+static bool arenaGrow(void)
+{
+    if (arenaChunkCount == arenaChunkCapacity)
+    {
+        size_t capacity = arenaChunkCapacity ? arenaChunkCapacity * 2 : 16;
+        AVLArenaChunk *chunks = realloc(arenaChunks, capacity * sizeof(*chunks));
+        if (!chunks)
+            return false;
+        arenaChunks = chunks;
+        arenaChunkCapacity = capacity;
+    }
+
+    int backing;
+    char *base = arenaMapChunk(AVL_ARENA_CHUNK_SIZE, &backing);
+    if (!base)
+        return false;
+    arenaChunks[arenaChunkCount].base = base;
+    arenaChunks[arenaChunkCount].bytes = AVL_ARENA_CHUNK_SIZE;
+    arenaChunks[arenaChunkCount].backing = backing;
+    arenaChunkCount++;
+    arenaNext = base;
+    arenaEnd = base + AVL_ARENA_CHUNK_SIZE;
+    return true;
+}
+
+static AVLNode *arenaAllocate(void)
+{
+    pthread_mutex_lock(&arenaLock);
+    AVLNode *node = arenaFreeList;
+    if (node)
+    {
+        arenaFreeList = node->left;
+        arenaNodesFree--;
+    }
+    else if ((size_t)(arenaEnd - arenaNext) >= sizeof(AVLNode) || arenaGrow())
+    {
+        node = (AVLNode *)arenaNext;
+        arenaNext += sizeof(AVLNode);
+    }
+    if (node)
+        arenaNodesInUse++;
+    pthread_mutex_unlock(&arenaLock);
+    return node;
+}
+
+static void arenaRelease(AVLNode *node)
+{
+    pthread_mutex_lock(&arenaLock);
+    node->left = arenaFreeList;
+    arenaFreeList = node;
+    arenaNodesInUse--;
+    arenaNodesFree++;
+    pthread_mutex_unlock(&arenaLock);
+}
+
+// bytes of the mmap-backed chunks that the kernel currently maps with transparent huge
+// pages. smaps reports AnonHugePages per mapping, and the kernel may merge a chunk with
+// neighbouring anonymous memory, so each mapping counts for at most its chunk bytes
+static size_t arenaThpBytes(void)
+{
+    FILE *smaps = fopen("/proc/self/smaps", "r");
+    if (!smaps)
+        return 0;
+
+    char line[256];
+    uintptr_t start = 0, end = 0;
+    size_t total = 0;
+    while (fgets(line, sizeof(line), smaps))
+    {
+        unsigned long from, to;
+        size_t kb;
+        if (sscanf(line, "AnonHugePages: %zu kB", &kb) == 1)
+        {
+            size_t overlap = 0;
+            for (size_t i = 0; kb && i < arenaChunkCount; i++)
+            {
+                uintptr_t lo = MAX(start, (uintptr_t)arenaChunks[i].base);
+                uintptr_t hi = (uintptr_t)arenaChunks[i].base + arenaChunks[i].bytes;
+                hi = hi < end ? hi : end;
+                if (arenaChunks[i].backing == AVL_CHUNK_MMAP && hi > lo)
+                    overlap += hi - lo;
+            }
+            total += kb * 1024 < overlap ? kb * 1024 : overlap;
+        }
+        else if (sscanf(line, "%lx-%lx ", &from, &to) == 2)
+        {
+            start = from;
+            end = to;
+        }
+    }
+    fclose(smaps);
+    return total;
+}
+#endif
+
+// node arena usage and how much of it huge pages back
+bool avlArenaStats(AVLArenaStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+#ifdef AVL_NODE_ARENA
+    pthread_mutex_lock(&arenaLock);
+    stats->chunks = arenaChunkCount;
+    for (size_t i = 0; i < arenaChunkCount; i++)
+    {
+        stats->bytes += arenaChunks[i].bytes;
+        if (arenaChunks[i].backing == AVL_CHUNK_HUGETLB)
+            stats->hugetlbBytes += arenaChunks[i].bytes;
+        else if (arenaChunks[i].backing == AVL_CHUNK_MALLOC)
+            stats->fallbackBytes += arenaChunks[i].bytes;
+    }
+    stats->thpBytes = arenaThpBytes();
+    stats->nodesInUse = arenaNodesInUse;
+    stats->nodesFree = arenaNodesFree;
+    pthread_mutex_unlock(&arenaLock);
+    stats->hugePageRatio = stats->bytes ? (double)(stats->hugetlbBytes + stats->thpBytes) / stats->bytes : 0.0;
+    return true;
+#else
+    return false;
+#endif
 }
 
 // create a new AVL node
 AVLNode *createNode(void *data)
 {
+#ifdef AVL_NODE_ARENA
+    AVLNode *node = arenaAllocate();
+#else
     AVLNode *node = malloc(sizeof(AVLNode));
+#endif
     if (!node)
     {
         perror("Failed to allocate memory for AVLNode");
@@ -46,11 +439,127 @@ AVLNode *createNode(void *data)
 
     node->data = data;
     node->left = node->right = NULL;
+#ifdef AVL_PARENT_POINTERS
+    node->parent = NULL;
+#endif
     node->height = 1;
     node->size = 1;
+    node->flags = 0;
+#ifdef AVL_TOMBSTONES
+    node->live = 1;
+#endif
+#ifdef AVL_KEY_HINTS
+    node->hint = 0;
+#endif
+    AVL_STAT_INC(allocations);
     return node;
 }
 
+// contiguous runs of nodes allocated by rebuildSubtree. A block is freed once every
+// node in it has been released; the registry is kept sorted by address so a node can
+// find its block with a binary search. Slots are sizeof(AVLNode), except that a key
+// node's slot also holds its AVLKey tail (see slotSize)
+typedef struct AVLNodeBlock
+{
+    AVLNode *nodes;
+    size_t inUse; // nodes not yet released
+} AVLNodeBlock;
+
+static AVLNodeBlock *nodeBlocks;
+static size_t nodeBlockCount;
+static size_t nodeBlockCapacity;
+static pthread_mutex_t nodeBlockLock = PTHREAD_MUTEX_INITIALIZER;
+
+// allocate and register a block of bytes holding count nodes; NULL if either
+// allocation fails
+static AVLNode *allocateNodeBlock(size_t bytes, size_t count)
+{
+    AVLNode *nodes = NULL;
+    if (bytes >= AVL_HUGE_PAGE_SIZE)
+    {
+        // whole, aligned huge pages so the kernel can back all of the block with them
+        void *memory;
+        bytes = (bytes + AVL_HUGE_PAGE_SIZE - 1) / AVL_HUGE_PAGE_SIZE * AVL_HUGE_PAGE_SIZE;
+        if (posix_memalign(&memory, AVL_HUGE_PAGE_SIZE, bytes) == 0)
+        {
+            nodes = memory;
+#ifdef MADV_HUGEPAGE
+            madvise(memory, bytes, MADV_HUGEPAGE); // a hint; failure just means small pages
+#endif
+        }
+    }
+    else
+        nodes = malloc(bytes);
+    if (!nodes)
+        return NULL;
+
+    pthread_mutex_lock(&nodeBlockLock);
+    if (nodeBlockCount == nodeBlockCapacity)
+    {
+        size_t capacity = nodeBlockCapacity ? nodeBlockCapacity * 2 : 16;
+        AVLNodeBlock *blocks = realloc(nodeBlocks, capacity * sizeof(*blocks));
+        if (!blocks)
+        {
+            pthread_mutex_unlock(&nodeBlockLock);
+            free(nodes);
+            return NULL;
+        }
+        nodeBlocks = blocks;
+        nodeBlockCapacity = capacity;
+    }
+
+    size_t i = nodeBlockCount++;
+    while (i > 0 && (uintptr_t)nodeBlocks[i - 1].nodes > (uintptr_t)nodes)
+    {
+        nodeBlocks[i] = nodeBlocks[i - 1];
+        i--;
+    }
+    nodeBlocks[i].nodes = nodes;
+    nodeBlocks[i].inUse = count;
+    pthread_mutex_unlock(&nodeBlockLock);
+    return nodes;
+}
+
+// drop one node of a block, freeing the block with its last node
+static void releaseBlockNode(AVLNode *node)
+{
+    pthread_mutex_lock(&nodeBlockLock);
+    size_t lo = 0, hi = nodeBlockCount;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if ((uintptr_t)nodeBlocks[mid].nodes <= (uintptr_t)node)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    AVLNodeBlock *block = &nodeBlocks[lo - 1]; // the last block starting at or before node
+    if (--block->inUse == 0)
+    {
+        free(block->nodes);
+        memmove(block, block + 1, (nodeBlockCount - lo) * sizeof(*block));
+        nodeBlockCount--;
+    }
+    pthread_mutex_unlock(&nodeBlockLock);
+}
+
+// release a node's memory (its data is handled by the caller)
+static void releaseNode(AVLNode *node)
+{
+    AVL_STAT_INC(frees);
+    if (node->flags & AVL_NODE_BLOCK)
+        releaseBlockNode(node);
+    else if (node->flags & AVL_NODE_KEY)
+        free(node); // key nodes come from malloc, with their key behind them
+    else
+#ifdef AVL_NODE_ARENA
+        arenaRelease(node);
+#else
+        free(node);
+#endif
+}
+
 // right rotation
 AVLNode *rotateRight(AVLNode *node)
 {
@@ -60,6 +569,11 @@ AVLNode *rotateRight(AVLNode *node)
     AVLNode *pivot = node->left;
     node->left = pivot->right;
     pivot->right = node;
+#ifdef AVL_PARENT_POINTERS
+    pivot->parent = node->parent;
+    node->parent = pivot;
+    AVL_SET_PARENT(node->left, node);
+#endif
 
     updateHeight(node);
     updateHeight(pivot);
@@ -77,6 +591,11 @@ AVLNode *rotateLeft(AVLNode *node)
     AVLNode *pivot = node->right;
     node->right = pivot->left;
     pivot->left = node;
+#ifdef AVL_PARENT_POINTERS
+    pivot->parent = node->parent;
+    node->parent = pivot;
+    AVL_SET_PARENT(node->right, node);
+#endif
 
     updateHeight(node);
     updateHeight(pivot);
@@ -85,12 +604,35 @@ AVLNode *rotateLeft(AVLNode *node)
     return pivot;
 }
 
+// keep a requested AVL(k) balance within the supported range
+static int clampBalance(int maxBalance)
+{
+    if (maxBalance < 1)
+        return 1;
+    return maxBalance > AVL_RELAXED_BALANCE_MAX ? AVL_RELAXED_BALANCE_MAX : maxBalance;
+}
+
 // rebalance AVL tree after insertion or deletion
 AVLNode *rebalance(AVLNode *node)
+{
+    return rebalanceRelaxed(node, AVL_MAX_BALANCE);
+}
+
+// recompute AVL_NODE_DIRTY from a node's balance and its children's marks
+static void updateDirty(AVLNode *node)
 {
     if (!node)
-        return node;
+        return;
+    bool dirty = ABS(getBalance(node)) > AVL_MAX_BALANCE || (node->left && (node->left->flags & AVL_NODE_DIRTY)) ||
+                 (node->right && (node->right->flags & AVL_NODE_DIRTY));
+    node->flags = dirty ? node->flags | AVL_NODE_DIRTY : node->flags & ~AVL_NODE_DIRTY;
+}
 
+// rotate a subtree that is more than maxBalance out of balance. A single rotation
+// restores the balance as long as the heavy child leans at most maxBalance - 1 the
+// other way, so only sharper zig-zags need a double rotation
+static AVLNode *restoreBalance(AVLNode *node, int maxBalance)
+{
     // first update height and size
     updateHeight(node);
     updateSize(node);
@@ -98,25 +640,35 @@ AVLNode *rebalance(AVLNode *node)
     int balance = getBalance(node);
 
     // case 1: left subtree is too heavy (left-left or left-right)
-    if (balance > AVL_MAX_BALANCE)
+    if (balance > maxBalance)
     {
         int leftBalance = getBalance(node->left);
 
-        if (leftBalance < 0)
+        if (leftBalance < 1 - maxBalance)
+        {
             // left-right case: first rotate left child left, then rotate root right
             node->left = rotateLeft(node->left);
+            AVL_DOUBLE_ROTATION();
+        }
+        else
+            AVL_SINGLE_ROTATION();
         // left-left case (or converted from left-right): rotate root right
         return rotateRight(node);
     }
 
     // case 2: right subtree is too heavy (right-right or right-left)
-    if (balance < -AVL_MAX_BALANCE)
+    if (balance < -maxBalance)
     {
         int rightBalance = getBalance(node->right);
 
-        if (rightBalance > 0)
+        if (rightBalance > maxBalance - 1)
+        {
             // right-left case: first rotate right child right, then rotate root left
             node->right = rotateRight(node->right);
+            AVL_DOUBLE_ROTATION();
+        }
+        else
+            AVL_SINGLE_ROTATION();
         // right-right case (or converted from right-left): rotate root left
         return rotateLeft(node);
     }
@@ -125,194 +677,1766 @@ AVLNode *rebalance(AVLNode *node)
     return node;
 }
 
-// insert and keep balance
-AVLNode *insert(AVLNode *node, void *data, compare_func_t compare)
+// rebalance an AVL(k) tree; relaxed trees also mark where they are out of strict
+// balance so rebalanceAll can find those nodes later
+AVLNode *rebalanceRelaxed(AVLNode *node, int maxBalance)
 {
-    // 1. standard BST insertion
     if (!node)
-        return createNode(data);
+        return node;
+    maxBalance = clampBalance(maxBalance);
 
-    int cmp = compare(data, node->data);
-    if (cmp < 0)
-        node->left = insert(node->left, data, compare);
-    else if (cmp > 0)
-        node->right = insert(node->right, data, compare);
-    else
-        return node; // no duplicates allowed
+    AVLNode *root = restoreBalance(node, maxBalance);
+    if (maxBalance > AVL_MAX_BALANCE)
+    {
+        if (root != node)
+        {
+            // the rotated nodes are the new root's children
+            updateDirty(root->left);
+            updateDirty(root->right);
+        }
+        updateDirty(root);
+    }
+    return root;
+}
 
-    return rebalance(node);
+// bytes a node takes in a block: key nodes bring their AVLKey tail along, rounded up so
+// the next slot stays aligned
+static size_t slotSize(const AVLNode *node)
+{
+    if (!(node->flags & AVL_NODE_KEY))
+        return sizeof(AVLNode);
+    const AVLKey *key = node->data;
+    size_t align = sizeof(void *) > sizeof(unsigned long long) ? sizeof(void *) : sizeof(unsigned long long);
+    size_t bytes = sizeof(AVLNode) + sizeof(AVLKey) + key->length + key->valueLength;
+    return (bytes + align - 1) / align * align;
 }
 
-// search for a key in the AVL tree
-AVLNode *search(AVLNode *node, void *data, compare_func_t compare)
+static AVLNode *nextSlot(AVLNode *slot)
 {
-    while (node)
+    return (AVLNode *)((char *)slot + slotSize(slot));
+}
+
+// block bytes needed for the nodes of a subtree (tombstones left out with dropDeleted)
+static size_t subtreeSlotBytes(const AVLNode *node, bool dropDeleted)
+{
+    size_t bytes = 0;
+    for (; node; node = node->right)
     {
-        int cmp = compare(data, node->data);
-        if (cmp == 0)
-            return node;
-        else if (cmp < 0)
-            node = node->left;
-        else
-            node = node->right;
+        bytes += subtreeSlotBytes(node->left, dropDeleted);
+        if (!dropDeleted || isLive(node))
+            bytes += slotSize(node);
     }
-
-    return NULL; // not found
+    return bytes;
 }
 
-// find minimum node in a subtree
-AVLNode *findMin(AVLNode *node)
+// link the next count nodes of a block, taken in order from *cursor, into a perfectly
+// balanced subtree
+static AVLNode *buildBalanced(AVLNode **cursor, avl_size_t count)
 {
-    if (!node)
+    if (count <= 0)
         return NULL;
 
-    while (node->left)
-        node = node->left;
-
+    avl_size_t mid = count / 2;
+    AVLNode *left = buildBalanced(cursor, mid);
+    AVLNode *node = *cursor;
+    *cursor = nextSlot(node);
+    node->left = left;
+    node->right = buildBalanced(cursor, count - mid - 1);
+    AVL_SET_PARENT(node->left, node);
+    AVL_SET_PARENT(node->right, node);
+    node->flags &= ~AVL_NODE_DIRTY;
+    updateHeight(node);
+    updateSize(node);
     return node;
 }
 
-// delete a node and keep balance
-AVLNode *delete(AVLNode *node, void *data, compare_func_t compare, free_func_t free_data)
+// copy a node, with a key node's tail, into a block slot and release the original
+static void moveNode(AVLNode *slot, AVLNode *node)
+{
+    *slot = *node;
+    if (node->flags & AVL_NODE_KEY)
+    {
+        const AVLKey *key = node->data;
+        memcpy(slot + 1, key, sizeof(AVLKey) + key->length + key->valueLength);
+        slot->data = slot + 1;
+    }
+    slot->flags |= AVL_NODE_BLOCK;
+    AVL_STAT_INC(allocations);
+    releaseNode(node);
+}
+
+// move the nodes of a subtree in order into the block from out, releasing the
+// originals; with dropDeleted, tombstones are freed (data through free_data) instead
+// of moved. Returns the slot after the last one used
+static AVLNode *flattenInto(AVLNode *node, AVLNode *out, bool dropDeleted, free_func_t free_data)
 {
-    // 1. standard BST deletion
     if (!node)
-        return node;
+        return out;
 
-    int cmp = compare(data, node->data);
-    if (cmp < 0)
-        node->left = delete(node->left, data, compare, free_data);
-    else if (cmp > 0)
-        node->right = delete(node->right, data, compare, free_data);
+    AVLNode *right = node->right;
+    out = flattenInto(node->left, out, dropDeleted, free_data);
+    if (dropDeleted && !isLive(node))
+    {
+        if (free_data)
+            free_data(node->data);
+        releaseNode(node);
+    }
     else
     {
-        // node to be deleted found
-        if (!node->left || !node->right)
-        {
-            // node with only one child or no child
-            AVLNode *temp = node->left ? node->left : node->right;
-
-            if (!temp)
-            {
-                // no child case
-                if (free_data)
-                    free_data(node->data);
-                free(node);
-                return NULL;
-            }
-            else
-            {
-                // one child case: replace node with its child
-                if (free_data)
-                    free_data(node->data);
-                free(node);
-                return temp;
-            }
-        }
-        else
-        {
-            // node with two children: get the inorder successor
-            AVLNode *temp = findMin(node->right);
-
-            // copy the inorder successor's data to this node
-            void *temp_data = temp->data; // save the successor's data pointer
-            if (free_data)
-                free_data(node->data); // free current node's data
-            node->data = temp_data;    // assign successor's data to current node
-
-            // delete the inorder successor(data is already moved)
-            node->right = delete(node->right, temp->data, compare, NULL);
-        }
+        moveNode(out, node);
+        out = nextSlot(out);
     }
-
-    return rebalance(node);
+    return flattenInto(right, out, dropDeleted, free_data);
 }
 
-// create AVL tree from array
-AVLNode *createAVLFromArray(void *arr[], int size, compare_func_t compare)
+// rebuild a subtree from count of its nodes (see flattenInto), moved into one block
+static AVLNode *relocateBalanced(AVLNode *node, avl_size_t count, bool dropDeleted, free_func_t free_data)
 {
-    if (!arr || size <= 0)
-        return NULL;
+    AVLNode *nodes = count ? allocateNodeBlock(subtreeSlotBytes(node, dropDeleted), (size_t)count) : NULL;
+    if (count && !nodes)
+    {
+        perror("Failed to allocate node block");
+        return node;
+    }
 
-    AVLNode *root = NULL;
-    for (int i = 0; i < size; i++)
-        root = insert(root, arr[i], compare);
+#ifdef AVL_PARENT_POINTERS
+    AVLNode *parent = node->parent;
+#endif
+    flattenInto(node, nodes, dropDeleted, free_data);
+    AVLNode *cursor = nodes;
+    AVLNode *root = buildBalanced(&cursor, count);
+    AVL_SET_PARENT(root, parent);
     return root;
 }
 
-void printAVL(const AVLNode *root, const char *prefix, bool isLast, print_func_t print_data)
+// rebuild a subtree perfectly balanced in O(n), its nodes (tombstones included) moved in
+// order into one contiguous block; handles into the subtree are invalidated. The
+// subtree is left unchanged if the block cannot be allocated
+AVLNode *rebuildSubtree(AVLNode *node)
 {
-    if (!root)
-        return;
+    return node ? relocateBalanced(node, getSize(node), false, NULL) : node;
+}
 
-    // print current node
-    printf("%s%s", prefix, isLast ? "└── " : "├── ");
-    print_data(root->data);
-    printf(" [h:%d,b:%+d]\n", root->height, getBalance(root));
+#ifdef AVL_AUTO_REBUILD
+// scapegoat check on the way back up a relaxed update: rebuild the subtree once it is
+// AVL_REBUILD_HEIGHT_RATIO times taller than it needs to be. Strict AVL trees stay
+// within about 1.44x and are never checked. Rebuilding moves nodes, so this is opt-in
+static AVLNode *rebuildIfDegraded(AVLNode *node, int maxBalance)
+{
+    if (maxBalance == AVL_MAX_BALANCE || !node || getSize(node) < AVL_REBUILD_MIN_SIZE)
+        return node;
 
-    // early return if no children
-    if (!root->left && !root->right)
-        return;
+    int optimalHeight = 0;
+    while (getSize(node) >> optimalHeight)
+        optimalHeight++;
+    if (node->height > AVL_REBUILD_HEIGHT_RATIO * optimalHeight)
+        node = rebuildSubtree(node);
+    return node;
+}
+#else
+#define rebuildIfDegraded(node, maxBalance) (node)
+#endif
+
+// copy the node *link points to into the next slot of a block and point the link at the
+// copy. Its child links still hold the original children until those are moved in turn
+static void moveToSlot(AVLNode **link, AVLNode **next)
+{
+    AVLNode *slot = *next;
+    moveNode(slot, *link);
+    *next = nextSlot(slot);
+    *link = slot;
+}
 
-    // create new prefix with appropriate suffix
-    const char *suffix = isLast ? "    " : "│   ";
-    size_t newLen = strlen(prefix) + strlen(suffix) + 1;
-    char *newPrefix = malloc(newLen);
+static void moveVEB(AVLNode **link, int levels, AVLNode **next);
 
-    if (!newPrefix)
+// move the bottom trees hanging `depth` levels below an already moved node
+static void moveVEBBottoms(AVLNode *node, int depth, int levels, AVLNode **next)
+{
+    if (!node)
+        return;
+    if (depth == 1)
     {
-        perror("Failed to allocate memory for prefix");
+        moveVEB(&node->left, levels, next);
+        moveVEB(&node->right, levels, next);
         return;
     }
-
-    sprintf(newPrefix, "%s%s", prefix, suffix);
-
-    // print children nodes
-    if (root->right)
-        printAVL(root->right, newPrefix, !root->left, print_data);
-    if (root->left)
-        printAVL(root->left, newPrefix, true, print_data);
-
-    free(newPrefix);
+    moveVEBBottoms(node->left, depth - 1, levels, next);
+    moveVEBBottoms(node->right, depth - 1, levels, next);
 }
 
-// inorder traversal
-void inorderTraversal(const AVLNode *root, print_func_t print_data)
+// move the top `levels` levels of a subtree in van Emde Boas order: the top half of
+// the levels first, then each tree below it, every part laid out the same way
+static void moveVEB(AVLNode **link, int levels, AVLNode **next)
 {
-    if (!root)
+    if (!*link || levels <= 0)
+        return;
+    if (levels == 1)
+    {
+        moveToSlot(link, next);
         return;
+    }
 
-    inorderTraversal(root->left, print_data);
-    print_data(root->data);
-    printf(" ");
-    inorderTraversal(root->right, print_data);
+    int top = levels / 2;
+    moveVEB(link, top, next);
+    moveVEBBottoms(*link, top, levels - top, next);
 }
 
-// preorder traversal
-void preorderTraversal(const AVLNode *root, print_func_t print_data)
+// defragment a tree: every node moves into one contiguous block (huge-page backed when
+// large enough) in BFS or van Emde Boas order, so the first levels of every search share
+// cache lines and pages. The shape, marks and tombstones are unchanged and handles are
+// invalidated. The tree is left unchanged if the block cannot be allocated
+AVLNode *compactTree(AVLNode *root, AVLLayout layout)
 {
-    if (!root)
-        return;
+    avl_size_t count = getSize(root);
+    if (count == 0)
+        return root;
 
-    print_data(root->data);
-    printf(" ");
-    preorderTraversal(root->left, print_data);
-    preorderTraversal(root->right, print_data);
-}
+    AVLNode *nodes = allocateNodeBlock(subtreeSlotBytes(root, false), (size_t)count);
+    if (!nodes)
+    {
+        perror("Failed to allocate node block");
+        return root;
+    }
 
-// postorder traversal
-void postorderTraversal(const AVLNode *root, print_func_t print_data)
-{
-    if (!root)
-        return;
+    AVLNode *next = nodes;
+    if (layout == AVL_LAYOUT_VEB)
+        moveVEB(&root, getHeight(root), &next);
+    else
+    {
+        // the block itself is the BFS queue
+        moveToSlot(&root, &next);
+        for (AVLNode *node = nodes; node < next; node = nextSlot(node))
+        {
+            if (node->left)
+                moveToSlot(&node->left, &next);
+            if (node->right)
+                moveToSlot(&node->right, &next);
+        }
+    }
 
-    postorderTraversal(root->left, print_data);
-    postorderTraversal(root->right, print_data);
-    print_data(root->data);
-    printf(" ");
+#ifdef AVL_PARENT_POINTERS
+    for (AVLNode *node = nodes; node < next; node = nextSlot(node))
+    {
+        AVL_SET_PARENT(node->left, node);
+        AVL_SET_PARENT(node->right, node);
+    }
+#endif
+    AVL_SET_PARENT(root, NULL);
+    return root;
 }
 
-// find maximum node in a subtree
+// recursive insertion used by insert()
+static AVLNode *insertRecursive(AVLNode *node, void *data, compare_func_t compare, int maxBalance,
+                                free_func_t free_data)
+{
+    // 1. standard BST insertion
+    if (!node)
+        return createNode(data);
+
+    AVL_VISIT();
+    int cmp = AVL_COMPARE(compare, data, node->data);
+    if (cmp < 0)
+    {
+        node->left = insertRecursive(node->left, data, compare, maxBalance, free_data);
+        AVL_SET_PARENT(node->left, node);
+    }
+    else if (cmp > 0)
+    {
+        node->right = insertRecursive(node->right, data, compare, maxBalance, free_data);
+        AVL_SET_PARENT(node->right, node);
+    }
+    else
+    {
+        if (!isLive(node))
+        {
+            // the key's tombstone is revived in place: no allocation or rotation
+            if (free_data)
+                free_data(node->data);
+            node->data = data;
+            node->flags &= ~AVL_NODE_DELETED;
+            updateSize(node);
+        }
+        return node; // no duplicates allowed
+    }
+
+    return rebuildIfDegraded(rebalanceRelaxed(node, maxBalance), maxBalance);
+}
+
+// insert and keep balance
+AVLNode *insert(AVLNode *node, void *data, compare_func_t compare)
+{
+    return insertRelaxed(node, data, compare, AVL_MAX_BALANCE);
+}
+
+// insert into an AVL(k) tree
+AVLNode *insertRelaxed(AVLNode *node, void *data, compare_func_t compare, int maxBalance)
+{
+    AVL_OP_BEGIN();
+    node = insertRecursive(node, data, compare, clampBalance(maxBalance), NULL);
+    AVL_SET_PARENT(node, NULL);
+    AVL_OP_END(AVL_OP_INSERT, data);
+    return node;
+}
+
+// search for a key in the AVL tree
+AVLNode *search(AVLNode *node, void *data, compare_func_t compare)
+{
+    AVL_OP_BEGIN();
+    while (node)
+    {
+        AVL_VISIT();
+        int cmp = AVL_COMPARE(compare, data, node->data);
+        if (cmp == 0)
+            break;
+        else if (cmp < 0)
+            node = node->left;
+        else
+            node = node->right;
+    }
+    if (node && !isLive(node))
+        node = NULL;
+
+    AVL_OP_END(AVL_OP_SEARCH, data);
+    return node; // NULL if not found
+}
+
+#ifdef AVL_KEY_HINTS
+// hints order like the keys, so the comparator (and node->data) is only needed on a tie
+static inline int compareHinted(compare_func_t compare, const void *data, unsigned long long hint,
+                                const AVLNode *node)
+{
+    if (hint != node->hint)
+        return hint < node->hint ? -1 : 1;
+    return AVL_COMPARE(compare, data, node->data);
+}
+
+static AVLNode *insertHintedRecursive(AVLNode *node, void *data, compare_func_t compare, unsigned long long hint)
+{
+    if (!node)
+    {
+        node = createNode(data);
+        node->hint = hint;
+        return node;
+    }
+
+    AVL_VISIT();
+    int cmp = compareHinted(compare, data, hint, node);
+    if (cmp < 0)
+    {
+        node->left = insertHintedRecursive(node->left, data, compare, hint);
+        AVL_SET_PARENT(node->left, node);
+    }
+    else if (cmp > 0)
+    {
+        node->right = insertHintedRecursive(node->right, data, compare, hint);
+        AVL_SET_PARENT(node->right, node);
+    }
+    else
+    {
+        if (!isLive(node))
+        {
+            node->data = data;
+            node->flags &= ~AVL_NODE_DELETED;
+            updateSize(node);
+        }
+        return node; // no duplicates allowed
+    }
+
+    return rebalance(node);
+}
+#endif
+
+// insert, caching hint(data) in the new node
+AVLNode *insertHinted(AVLNode *root, void *data, compare_func_t compare, key_hint_func_t hint)
+{
+#ifdef AVL_KEY_HINTS
+    AVL_OP_BEGIN();
+    root = insertHintedRecursive(root, data, compare, hint(data));
+    AVL_SET_PARENT(root, NULL);
+    AVL_OP_END(AVL_OP_INSERT, data);
+    return root;
+#else
+    (void)hint;
+    return insert(root, data, compare);
+#endif
+}
+
+// search comparing cached hints first
+AVLNode *searchHinted(AVLNode *root, void *data, compare_func_t compare, key_hint_func_t hint)
+{
+#ifdef AVL_KEY_HINTS
+    AVL_OP_BEGIN();
+    unsigned long long key = hint(data);
+    AVLNode *node = root;
+    while (node)
+    {
+        AVL_VISIT();
+        int cmp = compareHinted(compare, data, key, node);
+        if (cmp == 0)
+            break;
+        node = cmp < 0 ? node->left : node->right;
+    }
+    if (node && !isLive(node))
+        node = NULL;
+    AVL_OP_END(AVL_OP_SEARCH, data);
+    return node;
+#else
+    (void)hint;
+    return search(root, data, compare);
+#endif
+}
+
+// find minimum node in a subtree
+AVLNode *findMin(AVLNode *node)
+{
+    if (!node)
+        return NULL;
+
+    while (node->left)
+        node = node->left;
+
+    return node;
+}
+
+static AVLNode *detachMin(AVLNode *root, AVLNode **min, int maxBalance);
+
+// recursive deletion used by delete()
+static AVLNode *deleteRecursive(AVLNode *node, void *data, compare_func_t compare, free_func_t free_data,
+                                int maxBalance)
+{
+    // 1. standard BST deletion
+    if (!node)
+        return node;
+
+    AVL_VISIT();
+    int cmp = AVL_COMPARE(compare, data, node->data);
+    if (cmp < 0)
+    {
+        node->left = deleteRecursive(node->left, data, compare, free_data, maxBalance);
+        AVL_SET_PARENT(node->left, node);
+    }
+    else if (cmp > 0)
+    {
+        node->right = deleteRecursive(node->right, data, compare, free_data, maxBalance);
+        AVL_SET_PARENT(node->right, node);
+    }
+    else
+    {
+        // node to be deleted found
+        if (!node->left || !node->right)
+        {
+            // node with only one child or no child
+            AVLNode *temp = node->left ? node->left : node->right;
+
+            if (!temp)
+            {
+                // no child case
+                if (free_data)
+                    free_data(node->data);
+                releaseNode(node);
+                return NULL;
+            }
+            else
+            {
+                // one child case: replace node with its child
+                if (free_data)
+                    free_data(node->data);
+                releaseNode(node);
+                return temp;
+            }
+        }
+        else
+        {
+            // node with two children: unlink the inorder successor and move that node
+            // into this one's place, so nodes never change the data they hold
+            AVLNode *successor;
+            AVLNode *right = detachMin(node->right, &successor, maxBalance);
+            successor->left = node->left;
+            successor->right = right;
+            AVL_SET_PARENT(successor->left, successor);
+            AVL_SET_PARENT(successor->right, successor);
+
+            if (free_data)
+                free_data(node->data);
+            releaseNode(node);
+            node = successor;
+        }
+    }
+
+    return rebuildIfDegraded(rebalanceRelaxed(node, maxBalance), maxBalance);
+}
+
+// delete a node and keep balance
+AVLNode *delete(AVLNode *node, void *data, compare_func_t compare, free_func_t free_data)
+{
+    return deleteRelaxed(node, data, compare, free_data, AVL_MAX_BALANCE);
+}
+
+// delete from an AVL(k) tree
+AVLNode *deleteRelaxed(AVLNode *node, void *data, compare_func_t compare, free_func_t free_data, int maxBalance)
+{
+    AVL_OP_BEGIN();
+    node = deleteRecursive(node, data, compare, free_data, clampBalance(maxBalance));
+    AVL_SET_PARENT(node, NULL);
+    AVL_OP_END(AVL_OP_DELETE, data);
+    return node;
+}
+
+// join two AVL trees and a middle node ordered between them: the middle node is hung
+// where the shorter tree's height is met on the taller tree's inner spine, and the
+// spine is rebalanced on the way back up (O(height difference) rotations)
+static AVLNode *joinAVL(AVLNode *left, AVLNode *middle, AVLNode *right)
+{
+    if (getHeight(left) > getHeight(right) + AVL_MAX_BALANCE)
+    {
+        left->right = joinAVL(left->right, middle, right);
+        AVL_SET_PARENT(left->right, left);
+        return rebalance(left);
+    }
+    if (getHeight(right) > getHeight(left) + AVL_MAX_BALANCE)
+    {
+        right->left = joinAVL(left, middle, right->left);
+        AVL_SET_PARENT(right->left, right);
+        return rebalance(right);
+    }
+
+    middle->left = left;
+    middle->right = right;
+    AVL_SET_PARENT(left, middle);
+    AVL_SET_PARENT(right, middle);
+    updateHeight(middle);
+    updateSize(middle);
+    return middle;
+}
+
+// post-order pass over the marked nodes: both subtrees are made strict AVL trees
+// first, then joined back together under their root
+static AVLNode *rebalanceMarked(AVLNode *node)
+{
+    if (!node || !(node->flags & AVL_NODE_DIRTY))
+        return node;
+
+    AVL_VISIT();
+    node->flags &= ~AVL_NODE_DIRTY;
+    AVLNode *left = rebalanceMarked(node->left);
+    AVLNode *right = rebalanceMarked(node->right);
+    return joinAVL(left, node, right);
+}
+
+// restore the strict AVL invariant after relaxed updates; the work is proportional to
+// the marked nodes and the rotations needed, so a balanced tree costs O(1)
+AVLNode *rebalanceAll(AVLNode *root)
+{
+    root = rebalanceMarked(root);
+    AVL_SET_PARENT(root, NULL);
+    return root;
+}
+
+// true while relaxed updates have left the tree out of strict AVL balance
+bool needsRebalance(const AVLNode *root)
+{
+    return root && (root->flags & AVL_NODE_DIRTY);
+}
+
+#ifdef AVL_TOMBSTONES
+// mark a key's node as deleted, decrementing live counts on the way back up
+static bool markDeleted(AVLNode *node, void *data, compare_func_t compare)
+{
+    if (!node)
+        return false;
+
+    AVL_VISIT();
+    int cmp = AVL_COMPARE(compare, data, node->data);
+    bool marked;
+    if (cmp == 0)
+    {
+        marked = isLive(node);
+        node->flags |= AVL_NODE_DELETED;
+    }
+    else
+        marked = markDeleted(cmp < 0 ? node->left : node->right, data, compare);
+
+    if (marked)
+        node->live--;
+    return marked;
+}
+
+// delete a key by leaving a tombstone: one descent, no rotations, and the node stays
+// allocated so a re-insert can revive it. Once tombstones pass AVL_TOMBSTONE_RATIO of
+// the tree it is compacted, which keeps the amortized cost per delete O(1) on top
+AVLNode *tombstoneDelete(AVLNode *root, void *data, compare_func_t compare, free_func_t free_data)
+{
+    AVL_OP_BEGIN();
+    bool marked = markDeleted(root, data, compare);
+    AVL_OP_END(AVL_OP_DELETE, data);
+
+    if (marked && (double)(getSize(root) - getLiveSize(root)) > AVL_TOMBSTONE_RATIO * (double)getSize(root))
+        root = compactTombstones(root, free_data);
+    return root;
+}
+
+// insert that revives a tombstone of the same key, passing its old data to free_data
+AVLNode *insertRevive(AVLNode *root, void *data, compare_func_t compare, free_func_t free_data)
+{
+    AVL_OP_BEGIN();
+    root = insertRecursive(root, data, compare, AVL_MAX_BALANCE, free_data);
+    AVL_SET_PARENT(root, NULL);
+    AVL_OP_END(AVL_OP_INSERT, data);
+    return root;
+}
+
+// remove every tombstone and rebuild the live nodes, moved into one contiguous block,
+// into a perfectly balanced tree in O(n); the tree is left unchanged if the block
+// cannot be allocated
+AVLNode *compactTombstones(AVLNode *root, free_func_t free_data)
+{
+    if (getLiveSize(root) == getSize(root))
+        return root;
+
+    root = relocateBalanced(root, getLiveSize(root), true, free_data);
+    AVL_SET_PARENT(root, NULL);
+    return root;
+}
+#endif
+
+// point the parent's link at a replacement subtree (parent NULL: it becomes the root)
+static void replaceChild(AVLNode *parent, const AVLNode *old, AVLNode *child)
+{
+    if (parent)
+    {
+        if (parent->left == old)
+            parent->left = child;
+        else
+            parent->right = child;
+    }
+    AVL_SET_PARENT(child, parent);
+}
+
+// remove path[length - 1] from the tree whose root is path[0], without comparisons.
+// The path is extended down to the successor when the node has two children, so the
+// caller must make room for it. Rebalancing walks back up the path and stops
+// rotating at the first subtree whose height is unchanged; above that only sizes are
+// updated. The node is freed, or reset to a detached leaf when detached is non-NULL.
+static AVLNode *deleteAlongPath(AVLNode **path, int length, free_func_t free_data, AVLNode **detached,
+                                int maxBalance)
+{
+    int index = length - 1;
+    AVLNode *target = path[index];
+    AVLNode *parent = index ? path[index - 1] : NULL;
+
+    if (!target->left || !target->right)
+    {
+        AVLNode *replacement = target->left ? target->left : target->right;
+        replaceChild(parent, target, replacement);
+        if (!index)
+            path[0] = replacement;
+        length = index; // rebalance the ancestors
+    }
+    else
+    {
+        // extend the path to the inorder successor and unlink it
+        AVLNode *successor = target->right;
+        path[length++] = successor;
+        while (successor->left)
+        {
+            AVL_VISIT();
+            successor = successor->left;
+            path[length++] = successor;
+        }
+        AVLNode *successorParent = path[length - 2];
+        if (successorParent == target)
+            target->right = successor->right;
+        else
+            successorParent->left = successor->right;
+        AVL_SET_PARENT(successor->right, successorParent);
+
+        // move the successor node into the target's place
+        successor->left = target->left;
+        successor->right = target->right;
+        successor->height = target->height;
+        AVL_SET_PARENT(successor->left, successor);
+        AVL_SET_PARENT(successor->right, successor);
+        replaceChild(parent, target, successor);
+        path[index] = successor;
+        length--; // rebalance from the successor's old parent
+    }
+
+    bool rebalancing = true;
+    for (int i = length - 1; i >= 0; i--)
+    {
+        AVLNode *node = path[i];
+        if (rebalancing)
+        {
+            int oldHeight = node->height;
+            AVLNode *sub = rebalanceRelaxed(node, maxBalance);
+            if (sub != node)
+            {
+                replaceChild(i ? path[i - 1] : NULL, node, sub);
+                path[i] = sub;
+            }
+            rebalancing = sub->height != oldHeight;
+        }
+        else
+        {
+            updateSize(node);
+            if (maxBalance > AVL_MAX_BALANCE)
+                updateDirty(node);
+        }
+    }
+
+    if (detached)
+    {
+        target->left = target->right = NULL;
+        target->height = 1;
+        target->flags &= ~AVL_NODE_DIRTY;
+        updateSize(target);
+        AVL_SET_PARENT(target, NULL);
+        *detached = target;
+    }
+    else
+    {
+        if (free_data)
+            free_data(target->data);
+        releaseNode(target);
+    }
+    return path[0];
+}
+
+// search that records the path from the root for deletePath; returns NULL (and an
+// empty path) when the key is missing or the path is longer than AVL_PATH_MAX
+AVLNode *searchPath(AVLNode *root, void *data, compare_func_t compare, AVLPath *path)
+{
+    if (!path)
+        return NULL;
+
+    AVL_OP_BEGIN();
+    AVLNode *node = root;
+    path->length = 0;
+    while (node && path->length < AVL_PATH_MAX)
+    {
+        AVL_VISIT();
+        path->nodes[path->length++] = node;
+        int cmp = AVL_COMPARE(compare, data, node->data);
+        if (cmp == 0)
+            break;
+        node = cmp < 0 ? node->left : node->right;
+    }
+    if (node && (path->nodes[path->length - 1] != node || !isLive(node)))
+        node = NULL; // ran out of path, or a tombstone
+    if (!node)
+        path->length = 0;
+
+    AVL_OP_END(AVL_OP_SEARCH, data);
+    return node;
+}
+
+// delete the node found by searchPath; the tree must not have changed since
+AVLNode *deletePath(AVLNode *root, AVLPath *path, free_func_t free_data)
+{
+    if (!root || !path || path->length <= 0 || path->nodes[0] != root)
+        return root;
+
+    // the successor of a node with two children extends the path
+    AVLNode *target = path->nodes[path->length - 1];
+    if (target->left && target->right)
+    {
+        int length = path->length + 1;
+        for (const AVLNode *node = target->right; node->left; node = node->left)
+            length++;
+        if (length > AVL_PATH_MAX)
+            return root;
+    }
+
+    AVL_OP_BEGIN();
+    root = deleteAlongPath(path->nodes, path->length, free_data, NULL, AVL_MAX_BALANCE);
+    path->length = 0;
+    AVL_OP_END(AVL_OP_DELETE, NULL);
+    return root;
+}
+
+// unlink the minimum node of a tree without freeing it; *min receives it as a detached
+// leaf (NULL for an empty tree) and the rebalanced tree is returned
+AVLNode *removeMin(AVLNode *root, AVLNode **min)
+{
+    if (!min)
+        return root;
+    return detachMin(root, min, AVL_MAX_BALANCE);
+}
+
+// removeMin for an AVL(k) tree
+static AVLNode *detachMin(AVLNode *root, AVLNode **min, int maxBalance)
+{
+    *min = NULL;
+    if (!root)
+        return root;
+
+    AVLNode *local[AVL_PATH_MAX];
+    AVLNode **path = local;
+    int height = getHeight(root);
+    if (height > AVL_PATH_MAX)
+    {
+        path = malloc((size_t)height * sizeof(*path));
+        if (!path)
+        {
+            perror("Failed to allocate removeMin path");
+            return root;
+        }
+    }
+
+    int length = 0;
+    for (AVLNode *node = root; node; node = node->left)
+    {
+        AVL_VISIT();
+        path[length++] = node;
+    }
+    root = deleteAlongPath(path, length, NULL, min, maxBalance);
+
+    if (path != local)
+        free(path);
+    return root;
+}
+
+// === Weak AVL trees ===
+// rank-balanced trees (Haeupler, Sen and Tarjan) that keep a rank in the height field:
+// every parent is 1 or 2 ranks above each child (a missing child has rank 0) and leaves
+// have rank 1. Inserts rebalance exactly like AVL, so without deletes ranks equal
+// heights; a delete does at most one single or double rotation, and rank changes are
+// O(1) amortized. Ranks never exceed 2 log2 n.
+
+// fix a node one of whose children may have reached its rank after an insert below it
+static AVLNode *wavlInsertFix(AVLNode *node)
+{
+    updateSize(node);
+    int rank = node->height;
+
+    // left child has a rank difference of 0
+    if (getHeight(node->left) == rank)
+    {
+        if (rank - getHeight(node->right) == 1)
+        {
+            node->height++; // 0,1 node: promote and let the parent check
+            return node;
+        }
+
+        AVLNode *child = node->left;
+        if (child->height - getHeight(child->right) == 2)
+        {
+            // the inner grandchild is a 2-child: rotate right, demote the old root
+            AVLNode *pivot = rotateRight(node);
+            node->height = rank - 1;
+            pivot->height = rank;
+            AVL_SINGLE_ROTATION();
+            return pivot;
+        }
+
+        // double rotation: the inner grandchild rises to the top and is promoted
+        node->left = rotateLeft(child);
+        AVLNode *pivot = rotateRight(node);
+        child->height = node->height = rank - 1;
+        pivot->height = rank;
+        AVL_DOUBLE_ROTATION();
+        return pivot;
+    }
+
+    // right child has a rank difference of 0
+    if (getHeight(node->right) == rank)
+    {
+        if (rank - getHeight(node->left) == 1)
+        {
+            node->height++;
+            return node;
+        }
+
+        AVLNode *child = node->right;
+        if (child->height - getHeight(child->left) == 2)
+        {
+            AVLNode *pivot = rotateLeft(node);
+            node->height = rank - 1;
+            pivot->height = rank;
+            AVL_SINGLE_ROTATION();
+            return pivot;
+        }
+
+        node->right = rotateRight(child);
+        AVLNode *pivot = rotateLeft(node);
+        child->height = node->height = rank - 1;
+        pivot->height = rank;
+        AVL_DOUBLE_ROTATION();
+        return pivot;
+    }
+
+    return node;
+}
+
+// fix a node one of whose subtrees may have lost a rank after a delete below it
+static AVLNode *wavlDeleteFix(AVLNode *node)
+{
+    updateSize(node);
+    int rank = node->height;
+
+    if (!node->left && !node->right)
+    {
+        node->height = 1; // a 2,2 leaf is demoted
+        return node;
+    }
+
+    // left child has a rank difference of 3
+    if (rank - getHeight(node->left) == 3)
+    {
+        AVLNode *sibling = node->right;
+        if (rank - sibling->height == 2)
+        {
+            node->height--; // demote and let the parent check
+            return node;
+        }
+
+        int outer = sibling->height - getHeight(sibling->right);
+        int inner = sibling->height - getHeight(sibling->left);
+        if (outer == 2 && inner == 2)
+        {
+            node->height--; // demote with the 2,2 sibling
+            sibling->height--;
+            return node;
+        }
+
+        if (outer == 1)
+        {
+            // rotate left: the sibling is promoted, the old root demoted (twice if a leaf)
+            AVLNode *pivot = rotateLeft(node);
+            pivot->height = rank;
+            node->height = node->left || node->right ? rank - 1 : 1;
+            AVL_SINGLE_ROTATION();
+            return pivot;
+        }
+
+        // double rotation: the inner nephew is promoted twice and takes the root's rank
+        node->right = rotateRight(sibling);
+        AVLNode *pivot = rotateLeft(node);
+        pivot->height = rank;
+        sibling->height = node->height = rank - 2;
+        AVL_DOUBLE_ROTATION();
+        return pivot;
+    }
+
+    // right child has a rank difference of 3
+    if (rank - getHeight(node->right) == 3)
+    {
+        AVLNode *sibling = node->left;
+        if (rank - sibling->height == 2)
+        {
+            node->height--;
+            return node;
+        }
+
+        int outer = sibling->height - getHeight(sibling->left);
+        int inner = sibling->height - getHeight(sibling->right);
+        if (outer == 2 && inner == 2)
+        {
+            node->height--;
+            sibling->height--;
+            return node;
+        }
+
+        if (outer == 1)
+        {
+            AVLNode *pivot = rotateRight(node);
+            pivot->height = rank;
+            node->height = node->left || node->right ? rank - 1 : 1;
+            AVL_SINGLE_ROTATION();
+            return pivot;
+        }
+
+        node->left = rotateLeft(sibling);
+        AVLNode *pivot = rotateRight(node);
+        pivot->height = rank;
+        sibling->height = node->height = rank - 2;
+        AVL_DOUBLE_ROTATION();
+        return pivot;
+    }
+
+    return node;
+}
+
+// recursive insertion used by wavlInsert()
+static AVLNode *wavlInsertRecursive(AVLNode *node, void *data, compare_func_t compare)
+{
+    if (!node)
+        return createNode(data);
+
+    AVL_VISIT();
+    int cmp = AVL_COMPARE(compare, data, node->data);
+    if (cmp < 0)
+    {
+        node->left = wavlInsertRecursive(node->left, data, compare);
+        AVL_SET_PARENT(node->left, node);
+    }
+    else if (cmp > 0)
+    {
+        node->right = wavlInsertRecursive(node->right, data, compare);
+        AVL_SET_PARENT(node->right, node);
+    }
+    else
+        return node; // no duplicates allowed
+
+    return wavlInsertFix(node);
+}
+
+// detach the minimum node of a WAVL subtree, returning the rebalanced remainder
+static AVLNode *wavlRemoveMin(AVLNode *node, AVLNode **min)
+{
+    AVL_VISIT();
+    if (!node->left)
+    {
+        *min = node;
+        return node->right;
+    }
+
+    node->left = wavlRemoveMin(node->left, min);
+    AVL_SET_PARENT(node->left, node);
+    return wavlDeleteFix(node);
+}
+
+// recursive deletion used by wavlDelete()
+static AVLNode *wavlDeleteRecursive(AVLNode *node, void *data, compare_func_t compare, free_func_t free_data)
+{
+    if (!node)
+        return node;
+
+    AVL_VISIT();
+    int cmp = AVL_COMPARE(compare, data, node->data);
+    if (cmp < 0)
+    {
+        node->left = wavlDeleteRecursive(node->left, data, compare, free_data);
+        AVL_SET_PARENT(node->left, node);
+    }
+    else if (cmp > 0)
+    {
+        node->right = wavlDeleteRecursive(node->right, data, compare, free_data);
+        AVL_SET_PARENT(node->right, node);
+    }
+    else
+    {
+        if (!node->left || !node->right)
+        {
+            // the child keeps its rank; the parent sees a 2- or 3-child
+            AVLNode *child = node->left ? node->left : node->right;
+            if (free_data)
+                free_data(node->data);
+            releaseNode(node);
+            return child;
+        }
+
+        // move the inorder successor node into this one's place, taking over its rank
+        AVLNode *successor;
+        AVLNode *right = wavlRemoveMin(node->right, &successor);
+        successor->left = node->left;
+        successor->right = right;
+        successor->height = node->height;
+        AVL_SET_PARENT(successor->left, successor);
+        AVL_SET_PARENT(successor->right, successor);
+
+        if (free_data)
+            free_data(node->data);
+        releaseNode(node);
+        node = successor;
+    }
+
+    return wavlDeleteFix(node);
+}
+
+// insert into a WAVL tree
+AVLNode *wavlInsert(AVLNode *node, void *data, compare_func_t compare)
+{
+    AVL_OP_BEGIN();
+    node = wavlInsertRecursive(node, data, compare);
+    AVL_SET_PARENT(node, NULL);
+    AVL_OP_END(AVL_OP_INSERT, data);
+    return node;
+}
+
+// delete from a WAVL tree
+AVLNode *wavlDelete(AVLNode *node, void *data, compare_func_t compare, free_func_t free_data)
+{
+    AVL_OP_BEGIN();
+    node = wavlDeleteRecursive(node, data, compare, free_data);
+    AVL_SET_PARENT(node, NULL);
+    AVL_OP_END(AVL_OP_DELETE, data);
+    return node;
+}
+
+#ifdef AVL_PARENT_POINTERS
+// in-order successor: O(1) amortized over a full walk
+AVLNode *avlNext(const AVLNode *node)
+{
+    if (!node)
+        return NULL;
+    if (node->right)
+        return findMin(node->right);
+
+    while (node->parent && node == node->parent->right)
+        node = node->parent;
+    return node->parent;
+}
+
+// in-order predecessor
+AVLNode *avlPrev(const AVLNode *node)
+{
+    if (!node)
+        return NULL;
+    if (node->left)
+        return findMax(node->left);
+
+    while (node->parent && node == node->parent->left)
+        node = node->parent;
+    return node->parent;
+}
+
+// delete a node by handle: the path is rebuilt from the parent links
+AVLNode *deleteNode(AVLNode *root, AVLNode *node, free_func_t free_data)
+{
+    if (!root || !node)
+        return root;
+
+    int depth = 0;
+    for (const AVLNode *n = node; n; n = n->parent)
+        depth++;
+    if (depth > AVL_PATH_MAX)
+        return root;
+
+    AVLPath path;
+    path.length = depth;
+    for (AVLNode *n = node; n; n = n->parent)
+        path.nodes[--depth] = n;
+    return deletePath(root, &path, free_data);
+}
+#endif
+
+// a key being looked up, with its prefix packed once per operation
+typedef struct KeyProbe
+{
+    const unsigned char *bytes;
+    size_t length;
+    unsigned long long prefix;
+} KeyProbe;
+
+// the first 8 bytes as a big-endian integer, zero padded: prefixes order like the keys
+// whenever they differ
+static unsigned long long keyPrefix(const unsigned char *bytes, size_t length)
+{
+    unsigned long long prefix = 0;
+    for (size_t i = 0; i < 8; i++)
+        prefix = prefix << 8 | (i < length ? bytes[i] : 0);
+    return prefix;
+}
+
+static KeyProbe makeProbe(const void *key, size_t length)
+{
+    KeyProbe probe = {key, length, keyPrefix(key, length)};
+    return probe;
+}
+
+// order a probe against a node's stored key: bytewise, then the shorter key first.
+// Differing prefixes decide with one integer comparison; on a tie the bytes are
+// compared from offset skip, which the caller knows both keys share. *shared gets a
+// lower bound on the common prefix length
+static int compareKey(const KeyProbe *probe, const AVLKey *stored, size_t skip, size_t *shared)
+{
+    AVL_STAT_INC(comparisons);
+    if (probe->prefix != stored->prefix)
+    {
+        *shared = 0;
+        return probe->prefix < stored->prefix ? -1 : 1;
+    }
+
+    size_t common = probe->length < stored->length ? probe->length : stored->length;
+    size_t i = common;
+    if (common > 8)
+    {
+        // equal prefixes mean equal first 8 bytes once both keys are that long
+        i = skip > 8 ? skip : 8;
+        while (i + 8 <= common)
+        {
+            uint64_t a, b;
+            memcpy(&a, probe->bytes + i, 8);
+            memcpy(&b, stored->bytes + i, 8);
+            if (a != b)
+                break;
+            i += 8;
+        }
+        while (i < common && probe->bytes[i] == stored->bytes[i])
+            i++;
+    }
+    *shared = i;
+    if (i < common)
+        return probe->bytes[i] < stored->bytes[i] ? -1 : 1;
+    return (probe->length > stored->length) - (probe->length < stored->length);
+}
+
+// descent state for skipping the bytes a probe shares with both bounds of the current
+// subtree: every key between them shares at least the shorter of the two prefixes
+typedef struct KeyBounds
+{
+    size_t low;  // common prefix with the last key passed on the left
+    size_t high; // common prefix with the last key passed on the right
+} KeyBounds;
+
+static int compareKeyStep(const KeyProbe *probe, const AVLKey *stored, KeyBounds *bounds)
+{
+    size_t shared;
+#ifdef AVL_KEY_PREFIX_SKIP
+    int cmp = compareKey(probe, stored, bounds->low < bounds->high ? bounds->low : bounds->high, &shared);
+    if (cmp < 0)
+        bounds->high = shared;
+    else if (cmp > 0)
+        bounds->low = shared;
+    return cmp;
+#else
+    (void)bounds;
+    return compareKey(probe, stored, 0, &shared);
+#endif
+}
+
+// comparator for trees built by insertKey, for the generic queries and validators
+int avlKeyCompare(const void *a, const void *b)
+{
+    const AVLKey *key = a;
+    KeyProbe probe = {key->bytes, key->length, key->prefix};
+    size_t shared;
+    return compareKey(&probe, b, 0, &shared);
+}
+
+// the value bytes stored after a key node's key (not aligned)
+void *avlKeyValue(const AVLNode *node)
+{
+    AVLKey *key = node->data;
+    return key->bytes + key->length;
+}
+
+// one allocation holding the node, then its AVLKey header, key bytes and value bytes
+static AVLNode *createKeyNode(const KeyProbe *probe, const void *value, size_t valueLength)
+{
+    size_t length = probe->length;
+    AVLNode *node = malloc(sizeof(AVLNode) + sizeof(AVLKey) + length + valueLength);
+    if (!node)
+    {
+        perror("Failed to allocate memory for AVLNode");
+        exit(EXIT_FAILURE);
+    }
+
+    AVLKey *tail = (AVLKey *)(node + 1);
+    tail->prefix = probe->prefix;
+    tail->length = (unsigned int)length;
+    tail->valueLength = (unsigned int)valueLength;
+    if (length)
+        memcpy(tail->bytes, probe->bytes, length);
+    if (valueLength)
+        memcpy(tail->bytes + length, value, valueLength);
+
+    node->data = tail;
+    node->left = node->right = NULL;
+#ifdef AVL_PARENT_POINTERS
+    node->parent = NULL;
+#endif
+    node->height = 1;
+    node->size = 1;
+    node->flags = AVL_NODE_KEY;
+#ifdef AVL_TOMBSTONES
+    node->live = 1;
+#endif
+#ifdef AVL_KEY_HINTS
+    node->hint = 0;
+#endif
+    AVL_STAT_INC(allocations);
+    return node;
+}
+
+static AVLNode *insertKeyRecursive(AVLNode *node, const KeyProbe *probe, KeyBounds bounds, const void *value,
+                                   size_t valueLength)
+{
+    if (!node)
+        return createKeyNode(probe, value, valueLength);
+
+    AVL_VISIT();
+    int cmp = compareKeyStep(probe, node->data, &bounds);
+    if (cmp < 0)
+    {
+        node->left = insertKeyRecursive(node->left, probe, bounds, value, valueLength);
+        AVL_SET_PARENT(node->left, node);
+    }
+    else if (cmp > 0)
+    {
+        node->right = insertKeyRecursive(node->right, probe, bounds, value, valueLength);
+        AVL_SET_PARENT(node->right, node);
+    }
+    else
+    {
+        if (!isLive(node))
+        {
+            // a tombstone's value lives in its allocation, so a new node takes its place
+            AVLNode *fresh = createKeyNode(probe, value, valueLength);
+            fresh->left = node->left;
+            fresh->right = node->right;
+            AVL_SET_PARENT(fresh->left, fresh);
+            AVL_SET_PARENT(fresh->right, fresh);
+            fresh->height = node->height;
+            updateSize(fresh);
+            releaseNode(node);
+            node = fresh;
+        }
+        return node; // no duplicates allowed
+    }
+
+    return rebalance(node);
+}
+
+// insert a copy of key (and value) in a single allocation; duplicates are ignored
+AVLNode *insertKey(AVLNode *root, const void *key, size_t length, const void *value, size_t valueLength)
+{
+    if (length > UINT_MAX || valueLength > UINT_MAX)
+        return root;
+
+    AVL_OP_BEGIN();
+    KeyProbe probe = makeProbe(key, length);
+    KeyBounds bounds = {0, 0};
+    root = insertKeyRecursive(root, &probe, bounds, value, valueLength);
+    AVL_SET_PARENT(root, NULL);
+    AVL_OP_END(AVL_OP_INSERT, NULL);
+    return root;
+}
+
+// search by key bytes; comparisons read the prefix next to the node and only touch the
+// key bytes past the part shared with both bounds of the subtree
+AVLNode *searchKey(AVLNode *root, const void *key, size_t length)
+{
+    AVL_OP_BEGIN();
+    KeyProbe probe = makeProbe(key, length);
+    KeyBounds bounds = {0, 0};
+    AVLNode *node = root;
+    while (node)
+    {
+        AVL_VISIT();
+        int cmp = compareKeyStep(&probe, node->data, &bounds);
+        if (cmp == 0)
+            break;
+        node = cmp < 0 ? node->left : node->right;
+    }
+    if (node && !isLive(node))
+        node = NULL;
+    AVL_OP_END(AVL_OP_SEARCH, NULL);
+    return node;
+}
+
+// delete by key bytes, freeing the node with its key and value
+AVLNode *deleteKey(AVLNode *root, const void *key, size_t length)
+{
+    KeyProbe probe = makeProbe(key, length);
+    KeyBounds bounds = {0, 0};
+    AVLPath path;
+    path.length = 0;
+    for (AVLNode *node = root; node && path.length < AVL_PATH_MAX;)
+    {
+        path.nodes[path.length++] = node;
+        int cmp = compareKeyStep(&probe, node->data, &bounds);
+        if (cmp == 0)
+            return deletePath(root, &path, NULL);
+        node = cmp < 0 ? node->left : node->right;
+    }
+    return root;
+}
+
+// create AVL tree from array
+AVLNode *createAVLFromArray(void *arr[], avl_size_t size, compare_func_t compare)
+{
+    if (!arr || size <= 0)
+        return NULL;
+
+    AVLNode *root = NULL;
+    for (avl_size_t i = 0; i < size; i++)
+        root = insert(root, arr[i], compare);
+    return root;
+}
+
+// explicit stacks for the iterative walks live on the C stack up to this height;
+// only deeper (unbalanced) trees need one heap allocation per call
+#define AVL_WALK_STACK 64
+
+// visit every node in the given order without recursion, stopping as soon as the
+// callback returns nonzero; returns that value, 0 after a full walk, or -1 if a
+// tree deeper than AVL_WALK_STACK could not get its stack
+int visitAVL(const AVLNode *root, AVLOrder order, visit_func_t visit, void *context)
+{
+    if (!root || !visit)
+        return 0;
+
+    const AVLNode *local[AVL_WALK_STACK];
+    const AVLNode **stack = local;
+    int height = getHeight(root);
+    if (height > AVL_WALK_STACK)
+    {
+        stack = malloc((size_t)height * sizeof(*stack));
+        if (!stack)
+        {
+            perror("Failed to allocate traversal stack");
+            return -1;
+        }
+    }
+
+    int top = 0, result = 0;
+    const AVLNode *node = root, *last = NULL;
+    switch (order)
+    {
+    case AVL_INORDER:
+        while (node || top)
+        {
+            while (node)
+            {
+                stack[top++] = node;
+                node = node->left;
+            }
+            node = stack[--top];
+            if (isLive(node) && (result = visit(node->data, context)) != 0)
+                break;
+            node = node->right;
+        }
+        break;
+
+    case AVL_PREORDER:
+        // only right children still to be visited are stacked
+        while (node)
+        {
+            if (isLive(node) && (result = visit(node->data, context)) != 0)
+                break;
+            if (node->left && node->right)
+                stack[top++] = node->right;
+            node = node->left ? node->left : node->right;
+            if (!node && top)
+                node = stack[--top];
+        }
+        break;
+
+    case AVL_POSTORDER:
+        while (node || top)
+        {
+            if (node)
+            {
+                stack[top++] = node;
+                node = node->left;
+                continue;
+            }
+            const AVLNode *peek = stack[top - 1];
+            if (peek->right && peek->right != last)
+                node = peek->right;
+            else
+            {
+                if (isLive(peek) && (result = visit(peek->data, context)) != 0)
+                    break;
+                last = peek;
+                top--;
+            }
+        }
+        break;
+    }
+
+    if (stack != local)
+        free(stack);
+    return result;
+}
+
+// pending node of a tree diagram
+typedef struct TreeFrame
+{
+    const AVLNode *node;
+    int depth;
+    bool isLast;
+} TreeFrame;
+
+#define TREE_BRANCH_BYTES 6 // strlen("│   "), the widest connector
+
+typedef void (*tree_line_func_t)(const AVLNode *node, const char *branches, bool isLast, void *context);
+
+// walk the tree in diagram order (node, right subtree, left subtree), passing each
+// node the connectors of its ancestors; one prefix buffer is shared by all lines
+static void walkTreeLines(const AVLNode *root, bool isLast, tree_line_func_t line, void *context)
+{
+    if (!root)
+        return;
+
+    TreeFrame localFrames[AVL_WALK_STACK + 1];
+    size_t localOffsets[AVL_WALK_STACK + 1];
+    char localBranches[TREE_BRANCH_BYTES * AVL_WALK_STACK + 1];
+    TreeFrame *frames = localFrames;
+    size_t *offsets = localOffsets;
+    char *branches = localBranches;
+    void *heap = NULL;
+
+    int height = getHeight(root);
+    if (height > AVL_WALK_STACK)
+    {
+        size_t levels = (size_t)height + 1;
+        heap = malloc(levels * (sizeof(TreeFrame) + sizeof(size_t)) + TREE_BRANCH_BYTES * levels);
+        if (!heap)
+        {
+            perror("Failed to allocate memory for prefix");
+            return;
+        }
+        frames = heap;
+        offsets = (size_t *)(frames + levels);
+        branches = (char *)(offsets + levels);
+    }
+
+    int top = 0;
+    frames[top++] = (TreeFrame){root, 0, isLast};
+    offsets[0] = 0;
+    while (top)
+    {
+        TreeFrame f = frames[--top];
+        size_t len = offsets[f.depth];
+        branches[len] = '\0';
+        line(f.node, branches, f.isLast, context);
+
+        if (!f.node->left && !f.node->right)
+            continue;
+
+        // the children share this node's prefix plus one connector
+        const char *suffix = f.isLast ? "    " : "│   ";
+        strcpy(branches + len, suffix);
+        offsets[f.depth + 1] = len + strlen(suffix);
+
+        // push left first so the right child is printed first
+        if (f.node->left)
+            frames[top++] = (TreeFrame){f.node->left, f.depth + 1, true};
+        if (f.node->right)
+            frames[top++] = (TreeFrame){f.node->right, f.depth + 1, !f.node->left};
+    }
+
+    free(heap);
+}
+
+typedef struct PrintContext
+{
+    const char *prefix;
+    print_func_t print_data;
+} PrintContext;
+
+static void printLine(const AVLNode *node, const char *branches, bool isLast, void *context)
+{
+    const PrintContext *ctx = context;
+    printf("%s%s%s", ctx->prefix, branches, isLast ? "└── " : "├── ");
+    ctx->print_data(node->data);
+    printf(" [h:%d,b:%+d]\n", getHeight(node), getBalance(node));
+}
+
+void printAVL(const AVLNode *root, const char *prefix, bool isLast, print_func_t print_data)
+{
+    PrintContext ctx = {prefix ? prefix : "", print_data};
+    walkTreeLines(root, isLast, printLine, &ctx);
+}
+
+static int printNode(const void *data, void *context)
+{
+    print_func_t print_data = *(print_func_t *)context;
+    print_data(data);
+    putchar(' ');
+    return 0;
+}
+
+// inorder traversal
+void inorderTraversal(const AVLNode *root, print_func_t print_data)
+{
+    visitAVL(root, AVL_INORDER, printNode, &print_data);
+}
+
+// preorder traversal
+void preorderTraversal(const AVLNode *root, print_func_t print_data)
+{
+    visitAVL(root, AVL_PREORDER, printNode, &print_data);
+}
+
+// postorder traversal
+void postorderTraversal(const AVLNode *root, print_func_t print_data)
+{
+    visitAVL(root, AVL_POSTORDER, printNode, &print_data);
+}
+
+// formatting helpers that avoid printf (fast, and safe inside signal handlers)
+static char *appendString(char *p, const char *str)
+{
+    while (*str)
+        *p++ = *str++;
+    return p;
+}
+
+static char *appendNumber(char *p, unsigned long long value, unsigned base, int width)
+{
+    char digits[64];
+    int n = 0;
+    do
+    {
+        digits[n++] = "0123456789abcdef"[value % base];
+        value /= base;
+    } while (value);
+    while (n < width)
+        digits[n++] = '0';
+    while (n)
+        *p++ = digits[--n];
+    return p;
+}
+
+// buffered output for the dump functions, flushed to a FILE or a file descriptor
+#define AVL_DUMP_BUFFER 65536
+
+typedef struct AVLWriter
+{
+    FILE *file; // NULL to write to fd
+    int fd;
+    bool ok;
+    size_t len;   // bytes buffered
+    size_t count; // nodes written by a traversal
+    format_func_t format;
+    char buf[AVL_DUMP_BUFFER];
+} AVLWriter;
+
+static void writerFlush(AVLWriter *w)
+{
+    const char *p = w->buf;
+    size_t left = w->len;
+    w->len = 0;
+    if (!w->ok || left == 0)
+        return;
+
+    if (w->file)
+    {
+        w->ok = fwrite(p, 1, left, w->file) == left;
+        return;
+    }
+    while (left)
+    {
+        ssize_t written = write(w->fd, p, left);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+        {
+            w->ok = false;
+            return;
+        }
+        p += written;
+        left -= (size_t)written;
+    }
+}
+
+static void writerPut(AVLWriter *w, const char *str)
+{
+    size_t n = strlen(str);
+    if (n > sizeof(w->buf) - w->len)
+        writerFlush(w);
+    if (n > sizeof(w->buf))
+        n = sizeof(w->buf);
+    memcpy(w->buf + w->len, str, n);
+    w->len += n;
+}
+
+// append one formatted payload, flushing first if it does not fit; payloads longer
+// than the whole buffer are truncated
+static void writerData(AVLWriter *w, const void *data)
+{
+    size_t space = sizeof(w->buf) - w->len;
+    int n = w->format(w->buf + w->len, space, data);
+    if (n >= 0 && (size_t)n >= space)
+    {
+        writerFlush(w);
+        n = w->format(w->buf, sizeof(w->buf), data);
+        if (n >= 0 && (size_t)n >= sizeof(w->buf))
+            n = (int)sizeof(w->buf) - 1;
+    }
+    if (n < 0)
+        w->ok = false;
+    else
+        w->len += (size_t)n;
+}
+
+static void dumpLine(const AVLNode *node, const char *branches, bool isLast, void *context)
+{
+    AVLWriter *w = context;
+    writerPut(w, branches);
+    writerPut(w, isLast ? "└── " : "├── ");
+    writerData(w, node->data);
+
+    char info[48];
+    int balance = getBalance(node);
+    char *p = appendString(info, " [h:");
+    p = appendNumber(p, (unsigned long long)getHeight(node), 10, 0);
+    p = appendString(p, balance < 0 ? ",b:-" : ",b:+");
+    p = appendNumber(p, (unsigned long long)ABS(balance), 10, 0);
+    p = appendString(p, "]\n");
+    *p = '\0';
+    writerPut(w, info);
+}
+
+static int dumpNode(const void *data, void *context)
+{
+    AVLWriter *w = context;
+    if (w->count++)
+        writerPut(w, " ");
+    writerData(w, data);
+    return 0;
+}
+
+// write the tree diagram (same layout as printAVL) or a traversal on one line
+static bool dumpTree(const AVLNode *root, bool diagram, AVLOrder order, FILE *file, int fd, format_func_t format)
+{
+    if (!format || (!file && fd < 0))
+        return false;
+
+    // the buffer is too large for some thread stacks
+    AVLWriter *w = malloc(sizeof(*w));
+    if (!w)
+    {
+        perror("Failed to allocate output buffer");
+        return false;
+    }
+    w->file = file;
+    w->fd = fd;
+    w->ok = true;
+    w->len = 0;
+    w->count = 0;
+    w->format = format;
+
+    if (diagram)
+        walkTreeLines(root, true, dumpLine, w);
+    else
+    {
+        if (visitAVL(root, order, dumpNode, w) < 0)
+            w->ok = false;
+        if (w->count)
+            writerPut(w, "\n");
+    }
+    writerFlush(w);
+
+    bool ok = w->ok;
+    free(w);
+    return ok;
+}
+
+bool dumpAVL(const AVLNode *root, FILE *out, format_func_t format)
+{
+    return dumpTree(root, true, AVL_INORDER, out, -1, format);
+}
+
+bool dumpAVLFd(const AVLNode *root, int fd, format_func_t format)
+{
+    return dumpTree(root, true, AVL_INORDER, NULL, fd, format);
+}
+
+bool dumpTraversal(const AVLNode *root, AVLOrder order, FILE *out, format_func_t format)
+{
+    return dumpTree(root, false, order, out, -1, format);
+}
+
+bool dumpTraversalFd(const AVLNode *root, AVLOrder order, int fd, format_func_t format)
+{
+    return dumpTree(root, false, order, NULL, fd, format);
+}
+// find maximum node in a subtree
 AVLNode *findMax(AVLNode *node)
 {
     if (!node)
@@ -334,7 +2458,7 @@ void freeAVLTree(AVLNode *root, free_func_t free_data)
     freeAVLTree(root->right, free_data);
     if (free_data)
         free_data(root->data);
-    free(root);
+    releaseNode(root);
 }
 
 // validate if tree is a valid binary search tree
@@ -343,32 +2467,79 @@ bool isValidBST(const AVLNode *root, void *minVal, void *maxVal, compare_func_t
     if (!root)
         return true;
 
-    if ((minVal && compare(root->data, minVal) <= 0) ||
-        (maxVal && compare(root->data, maxVal) >= 0))
+    if ((minVal && AVL_COMPARE(compare, root->data, minVal) <= 0) ||
+        (maxVal && AVL_COMPARE(compare, root->data, maxVal) >= 0))
         return false;
 
     return isValidBST(root->left, minVal, root->data, compare) &&
            isValidBST(root->right, root->data, maxVal, compare);
 }
 
+// subtree size (and live count) of a node agree with its children
+static bool countsConsistent(const AVLNode *root)
+{
+    if (getSize(root) != 1 + getSize(root->left) + getSize(root->right))
+        return false;
+    return getLiveSize(root) == (avl_size_t)isLive(root) + getLiveSize(root->left) + getLiveSize(root->right);
+}
+
 // validate if tree is a valid AVL tree
 bool isValidAVL(const AVLNode *root)
+{
+    return isValidAVLRelaxed(root, AVL_MAX_BALANCE);
+}
+
+// validate an AVL(k) tree: like isValidAVL, with |balance| up to maxBalance
+bool isValidAVLRelaxed(const AVLNode *root, int maxBalance)
 {
     if (!root)
         return true;
 
-    // check balance factor
+    // check balance factor; nodes out of strict balance must be marked, as must their ancestors
     int balance = getBalance(root);
-    if (ABS(balance) > AVL_MAX_BALANCE)
+    if (ABS(balance) > maxBalance)
+        return false;
+    bool dirtyBelow = (root->left && (root->left->flags & AVL_NODE_DIRTY)) ||
+                      (root->right && (root->right->flags & AVL_NODE_DIRTY));
+    if ((ABS(balance) > AVL_MAX_BALANCE || dirtyBelow) && !(root->flags & AVL_NODE_DIRTY))
         return false;
 
-    // check height consistency
+    // check height and size consistency
     int expectedHeight = 1 + MAX(getHeight(root->left), getHeight(root->right));
     if (root->height != expectedHeight)
         return false;
+    if (!countsConsistent(root))
+        return false;
+
+#ifdef AVL_PARENT_POINTERS
+    if ((root->left && root->left->parent != root) || (root->right && root->right->parent != root))
+        return false;
+#endif
 
     // recursively check subtrees
-    return isValidAVL(root->left) && isValidAVL(root->right);
+    return isValidAVLRelaxed(root->left, maxBalance) && isValidAVLRelaxed(root->right, maxBalance);
+}
+
+// validate a WAVL tree: rank differences of 1 or 2, leaves of rank 1, consistent sizes
+bool isValidWAVL(const AVLNode *root)
+{
+    if (!root)
+        return true;
+
+    int left = root->height - getHeight(root->left), right = root->height - getHeight(root->right);
+    if (left < 1 || left > 2 || right < 1 || right > 2)
+        return false;
+    if (!root->left && !root->right && root->height != 1)
+        return false;
+    if (!countsConsistent(root))
+        return false;
+
+#ifdef AVL_PARENT_POINTERS
+    if ((root->left && root->left->parent != root) || (root->right && root->right->parent != root))
+        return false;
+#endif
+
+    return isValidWAVL(root->left) && isValidWAVL(root->right);
 }
 
 // range query: call callback for all nodes with data in [minVal, maxVal]
@@ -378,15 +2549,15 @@ void rangeQuery(const AVLNode *root, void *minVal, void *maxVal, compare_func_t
     if (!root)
         return;
 
-    int cmpMin = minVal ? compare(root->data, minVal) : 1;
-    int cmpMax = maxVal ? compare(root->data, maxVal) : -1;
+    int cmpMin = minVal ? AVL_COMPARE(compare, root->data, minVal) : 1;
+    int cmpMax = maxVal ? AVL_COMPARE(compare, root->data, maxVal) : -1;
 
     // if current node is greater than minVal, check left subtree
     if (cmpMin > 0)
         rangeQuery(root->left, minVal, maxVal, compare, callback, context);
 
     // if current node is in range, process it
-    if (cmpMin >= 0 && cmpMax <= 0)
+    if (cmpMin >= 0 && cmpMax <= 0 && isLive(root))
         callback(root->data, context);
 
     // if current node is less than maxVal, check right subtree
@@ -394,23 +2565,141 @@ void rangeQuery(const AVLNode *root, void *minVal, void *maxVal, compare_func_t
         rangeQuery(root->right, minVal, maxVal, compare, callback, context);
 }
 
+#ifdef AVL_KEY_HINTS
+// a node against a range bound, in rangeQuery's argument order
+static inline int compareBoundHinted(compare_func_t compare, const AVLNode *node, void *bound,
+                                     unsigned long long boundHint)
+{
+    if (node->hint != boundHint)
+        return node->hint < boundHint ? -1 : 1;
+    return AVL_COMPARE(compare, node->data, bound);
+}
+
+// rangeQuery with the bounds' hints computed once
+static void rangeQueryHintedRecursive(const AVLNode *root, void *minVal, unsigned long long minHint, void *maxVal,
+                                      unsigned long long maxHint, compare_func_t compare,
+                                      void (*callback)(const void *data, void *context), void *context)
+{
+    if (!root)
+        return;
+
+    int cmpMin = minVal ? compareBoundHinted(compare, root, minVal, minHint) : 1;
+    int cmpMax = maxVal ? compareBoundHinted(compare, root, maxVal, maxHint) : -1;
+
+    if (cmpMin > 0)
+        rangeQueryHintedRecursive(root->left, minVal, minHint, maxVal, maxHint, compare, callback, context);
+    if (cmpMin >= 0 && cmpMax <= 0 && isLive(root))
+        callback(root->data, context);
+    if (cmpMax < 0)
+        rangeQueryHintedRecursive(root->right, minVal, minHint, maxVal, maxHint, compare, callback, context);
+}
+#endif
+
+// range query over a tree built by insertHinted
+void rangeQueryHinted(const AVLNode *root, void *minVal, void *maxVal, compare_func_t compare, key_hint_func_t hint,
+                      void (*callback)(const void *data, void *context), void *context)
+{
+#ifdef AVL_KEY_HINTS
+    rangeQueryHintedRecursive(root, minVal, minVal ? hint(minVal) : 0, maxVal, maxVal ? hint(maxVal) : 0, compare,
+                              callback, context);
+#else
+    (void)hint;
+    rangeQuery(root, minVal, maxVal, compare, callback, context);
+#endif
+}
+
+// in-order walk over [minVal, maxVal] (NULL = unbounded) with Morris threading: the
+// right pointer of each left subtree's rightmost node temporarily points back to the
+// subtree's parent, so no stack is needed and every node is touched a bounded number
+// of times. After the last key or an early stop, the walk continues without visiting
+// or threading to remove the threads that are still in place.
+static int morrisWalk(AVLNode *root, void *minVal, void *maxVal, compare_func_t compare, visit_func_t visit,
+                      void *context)
+{
+    AVLNode *cur = root;
+    int result = 0;
+    bool done = false;
+
+    while (cur)
+    {
+        if (cur->left)
+        {
+            AVLNode *pred = cur->left;
+            while (pred->right && pred->right != cur)
+                pred = pred->right;
+
+            if (pred->right == cur)
+                pred->right = NULL; // back from the left subtree: remove the thread
+            else if (!done && (!minVal || AVL_COMPARE(compare, cur->data, minVal) > 0))
+            {
+                pred->right = cur;
+                cur = cur->left;
+                continue;
+            }
+            // else the left subtree holds nothing to visit: skip it
+        }
+
+        if (!done)
+        {
+            if (maxVal && AVL_COMPARE(compare, cur->data, maxVal) > 0)
+                done = true;
+            else if (isLive(cur) && (!minVal || AVL_COMPARE(compare, cur->data, minVal) >= 0))
+                done = (result = visit(cur->data, context)) != 0;
+        }
+        cur = cur->right;
+    }
+    return result;
+}
+
+// in-order visitor using Morris threading: O(1) extra space, but the tree is modified
+// while the walk runs, so it must not be read or written concurrently
+int visitAVLMorris(AVLNode *root, visit_func_t visit, void *context)
+{
+    if (!visit)
+        return 0;
+    return morrisWalk(root, NULL, NULL, NULL, visit, context);
+}
+
+typedef struct RangeCallback
+{
+    void (*callback)(const void *data, void *context);
+    void *context;
+} RangeCallback;
+
+static int rangeVisit(const void *data, void *context)
+{
+    RangeCallback *range = context;
+    range->callback(data, range->context);
+    return 0;
+}
+
+// rangeQuery without a stack or recursion (same caveats as visitAVLMorris)
+void rangeQueryMorris(AVLNode *root, void *minVal, void *maxVal, compare_func_t compare,
+                      void (*callback)(const void *data, void *context), void *context)
+{
+    if (!callback)
+        return;
+    RangeCallback range = {callback, context};
+    morrisWalk(root, minVal, maxVal, compare, rangeVisit, &range);
+}
+
 // count nodes in range [minVal, maxVal]
-int countRange(const AVLNode *root, void *minVal, void *maxVal, compare_func_t compare)
+avl_size_t countRange(const AVLNode *root, void *minVal, void *maxVal, compare_func_t compare)
 {
     if (!root)
         return 0;
 
-    int cmpMin = minVal ? compare(root->data, minVal) : 1;
-    int cmpMax = maxVal ? compare(root->data, maxVal) : -1;
+    int cmpMin = minVal ? AVL_COMPARE(compare, root->data, minVal) : 1;
+    int cmpMax = maxVal ? AVL_COMPARE(compare, root->data, maxVal) : -1;
 
-    int count = 0;
+    avl_size_t count = 0;
 
     // if current node is greater than minVal, check left subtree
     if (cmpMin > 0)
         count += countRange(root->left, minVal, maxVal, compare);
 
     // if current node is in range, count it
-    if (cmpMin >= 0 && cmpMax <= 0)
+    if (cmpMin >= 0 && cmpMax <= 0 && isLive(root))
         count++;
 
     // if current node is less than maxVal, check right subtree
@@ -421,54 +2710,620 @@ int countRange(const AVLNode *root, void *minVal, void *maxVal, compare_func_t c
 }
 
 // find kth smallest element (1-indexed)
-AVLNode *findKthSmallest(AVLNode *root, int k)
+AVLNode *findKthSmallest(AVLNode *root, avl_size_t k)
 {
     if (!root || k <= 0)
         return NULL;
 
-    int leftSize = getSize(root->left);
+    avl_size_t leftSize = getLiveSize(root->left), self = isLive(root);
 
-    if (k == leftSize + 1)
+    if (self && k == leftSize + 1)
         return root;
     else if (k <= leftSize)
         return findKthSmallest(root->left, k);
     else
-        return findKthSmallest(root->right, k - leftSize - 1);
+        return findKthSmallest(root->right, k - leftSize - self);
 }
 
 // find kth largest element (1-indexed)
-AVLNode *findKthLargest(AVLNode *root, int k)
+AVLNode *findKthLargest(AVLNode *root, avl_size_t k)
 {
     if (!root || k <= 0)
         return NULL;
 
-    int rightSize = getSize(root->right);
+    avl_size_t rightSize = getLiveSize(root->right), self = isLive(root);
 
-    if (k == rightSize + 1)
+    if (self && k == rightSize + 1)
         return root;
     else if (k <= rightSize)
         return findKthLargest(root->right, k);
     else
-        return findKthLargest(root->left, k - rightSize - 1);
+        return findKthLargest(root->left, k - rightSize - self);
 }
 
 // get rank (1-indexed position) of an element in AVL tree
-int getRank(const AVLNode *root, void *data, compare_func_t compare)
+avl_size_t getRank(const AVLNode *root, void *data, compare_func_t compare)
 {
     if (!root)
         return 0;
 
-    int cmp = compare(data, root->data);
+    int cmp = AVL_COMPARE(compare, data, root->data);
 
     if (cmp == 0)
-        // found the element: rank = size of left subtree + 1
-        return getSize(root->left) + 1;
+        // found the element: rank = size of left subtree + 1 (tombstones have none)
+        return isLive(root) ? getLiveSize(root->left) + 1 : 0;
 
     if (cmp < 0)
         // element is in left subtree
         return getRank(root->left, data, compare);
 
     // element is in right subtree
-    int rightRank = getRank(root->right, data, compare);
-    return rightRank > 0 ? getSize(root->left) + 1 + rightRank : 0;
+    avl_size_t rightRank = getRank(root->right, data, compare);
+    return rightRank > 0 ? getLiveSize(root->left) + isLive(root) + rightRank : 0;
+}
+
+// subtree root with its depth, used by the iterative walks below
+typedef struct
+{
+    const AVLNode *node;
+    int depth;
+} DepthEntry;
+
+// bytes a node occupies, including the key and value of an insertKey node
+static size_t nodeFootprint(const AVLNode *node)
+{
+    if (!(node->flags & AVL_NODE_KEY))
+        return sizeof(AVLNode);
+    const AVLKey *key = node->data;
+    return sizeof(AVLNode) + sizeof(AVLKey) + key->length + key->valueLength;
+}
+
+// accumulate shape statistics of a subtree whose root sits at the given depth
+static void collectStats(const AVLNode *root, int depth, size_func_t payload_size, AVLTreeStats *stats)
+{
+    if (!root)
+        return;
+
+    // preorder with an explicit stack: at most one pending sibling per level
+    DepthEntry *stack = malloc((getHeight(root) + 1) * sizeof(DepthEntry));
+    if (!stack)
+    {
+        perror("Failed to allocate memory for stats stack");
+        return;
+    }
+
+    int top = 0;
+    stack[top++] = (DepthEntry){root, depth};
+    while (top > 0)
+    {
+        DepthEntry e = stack[--top];
+        const AVLNode *node = e.node;
+
+        stats->nodeCount++;
+        stats->nodeBytes += nodeFootprint(node);
+        if (payload_size)
+            stats->payloadBytes += payload_size(node->data);
+        if (!node->left && !node->right)
+            stats->leafCount++;
+        stats->depthHistogram[e.depth < AVL_DEPTH_BUCKETS ? e.depth : AVL_DEPTH_BUCKETS - 1]++;
+        stats->totalPathLength += (unsigned long long)e.depth + 1;
+        if (e.depth + 1 > stats->height)
+            stats->height = e.depth + 1;
+
+        if (node->right)
+            stack[top++] = (DepthEntry){node->right, e.depth + 1};
+        if (node->left)
+            stack[top++] = (DepthEntry){node->left, e.depth + 1};
+    }
+
+    free(stack);
+}
+
+// add partial statistics into a total
+static void mergeStats(AVLTreeStats *dst, const AVLTreeStats *src)
+{
+    dst->nodeCount += src->nodeCount;
+    dst->leafCount += src->leafCount;
+    dst->nodeBytes += src->nodeBytes;
+    dst->payloadBytes += src->payloadBytes;
+    dst->totalPathLength += src->totalPathLength;
+    if (src->height > dst->height)
+        dst->height = src->height;
+    for (int i = 0; i < AVL_DEPTH_BUCKETS; i++)
+        dst->depthHistogram[i] += src->depthHistogram[i];
+}
+
+// derive the ratios once all nodes are counted
+static void finishStats(AVLTreeStats *stats)
+{
+    size_t n = stats->nodeCount;
+
+    stats->optimalHeight = 0;
+    while (stats->optimalHeight < (int)(sizeof(size_t) * CHAR_BIT) && (n >> stats->optimalHeight))
+        stats->optimalHeight++;
+
+    stats->heightRatio = stats->optimalHeight ? (double)stats->height / stats->optimalHeight : 0.0;
+    stats->avgPathLength = n ? (double)stats->totalPathLength / n : 0.0;
+    stats->leafRatio = n ? (double)stats->leafCount / n : 0.0;
+}
+
+// compute shape and memory statistics of a tree
+void avlStats(const AVLNode *root, size_func_t payload_size, AVLTreeStats *stats)
+{
+    if (!stats)
+        return;
+
+    memset(stats, 0, sizeof(*stats));
+    collectStats(root, 0, payload_size, stats);
+    finishStats(stats);
+}
+
+// trees smaller than this are not worth the thread start-up cost
+#define AVL_PARALLEL_STATS_MIN 65536
+
+typedef struct
+{
+    DepthEntry *tasks;
+    int taskCount;
+    int next;
+    pthread_mutex_t lock;
+    size_func_t payload_size;
+} StatsJob;
+
+typedef struct
+{
+    StatsJob *job;
+    AVLTreeStats partial;
+} StatsWorker;
+
+static void *statsWorker(void *arg)
+{
+    StatsWorker *worker = arg;
+    StatsJob *job = worker->job;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&job->lock);
+        int task = job->next < job->taskCount ? job->next++ : -1;
+        pthread_mutex_unlock(&job->lock);
+        if (task < 0)
+            break;
+        collectStats(job->tasks[task].node, job->tasks[task].depth, job->payload_size, &worker->partial);
+    }
+    return NULL;
+}
+
+// compute statistics with the subtrees below the top levels spread over worker threads
+void avlStatsParallel(const AVLNode *root, size_func_t payload_size, AVLTreeStats *stats, int threads)
+{
+    if (!stats)
+        return;
+    if (threads <= 1 || getSize(root) < AVL_PARALLEL_STATS_MIN)
+    {
+        avlStats(root, payload_size, stats);
+        return;
+    }
+
+    memset(stats, 0, sizeof(*stats));
+
+    // split at the first level with a few subtrees per thread for load balancing
+    int splitDepth = 0;
+    while ((1 << splitDepth) < 4 * threads && splitDepth < 16)
+        splitDepth++;
+
+    size_t width = (size_t)1 << splitDepth;
+    StatsJob job = {.payload_size = payload_size};
+    job.tasks = malloc(width * sizeof(DepthEntry));
+    DepthEntry *level = malloc(width * sizeof(DepthEntry));
+    DepthEntry *nextLevel = malloc(width * sizeof(DepthEntry));
+    StatsWorker *workers = calloc(threads, sizeof(StatsWorker));
+    pthread_t *ids = malloc(threads * sizeof(pthread_t));
+    if (!job.tasks || !level || !nextLevel || !workers || !ids)
+    {
+        free(job.tasks);
+        free(level);
+        free(nextLevel);
+        free(workers);
+        free(ids);
+        avlStats(root, payload_size, stats);
+        return;
+    }
+
+    // count the nodes above the split level here, collecting the subtrees below it
+    int levelCount = 0;
+    level[levelCount++] = (DepthEntry){root, 0};
+    while (levelCount > 0)
+    {
+        int nextCount = 0;
+        for (int i = 0; i < levelCount; i++)
+        {
+            DepthEntry e = level[i];
+            if (e.depth == splitDepth)
+            {
+                job.tasks[job.taskCount++] = e;
+                continue;
+            }
+
+            const AVLNode *node = e.node;
+            stats->nodeCount++;
+            stats->nodeBytes += nodeFootprint(node);
+            if (payload_size)
+                stats->payloadBytes += payload_size(node->data);
+            if (!node->left && !node->right)
+                stats->leafCount++;
+            stats->depthHistogram[e.depth]++;
+            stats->totalPathLength += (unsigned long long)e.depth + 1;
+            if (e.depth + 1 > stats->height)
+                stats->height = e.depth + 1;
+
+            if (node->left)
+                nextLevel[nextCount++] = (DepthEntry){node->left, e.depth + 1};
+            if (node->right)
+                nextLevel[nextCount++] = (DepthEntry){node->right, e.depth + 1};
+        }
+
+        DepthEntry *swap = level;
+        level = nextLevel;
+        nextLevel = swap;
+        levelCount = nextCount;
+    }
+
+    pthread_mutex_init(&job.lock, NULL);
+    int started = 0;
+    for (int t = 0; t < threads; t++)
+    {
+        workers[t].job = &job;
+        if (pthread_create(&ids[t], NULL, statsWorker, &workers[t]) != 0)
+            break;
+        started++;
+    }
+    if (started == 0)
+        statsWorker(&workers[0]); // no threads available: do the work here
+    for (int t = 0; t < started; t++)
+        pthread_join(ids[t], NULL);
+    pthread_mutex_destroy(&job.lock);
+
+    for (int t = 0; t < threads; t++)
+        mergeStats(stats, &workers[t].partial);
+    finishStats(stats);
+
+    free(job.tasks);
+    free(level);
+    free(nextLevel);
+    free(workers);
+    free(ids);
+}
+
+// copy the operation counters
+void getOpStats(AVLOpStats *stats)
+{
+    if (!stats)
+        return;
+#ifdef AVL_STATS
+    *stats = opStats;
+#else
+    memset(stats, 0, sizeof(*stats));
+#endif
+}
+
+// reset the operation counters
+void resetOpStats(void)
+{
+#ifdef AVL_STATS
+    memset(&opStats, 0, sizeof(opStats));
+#endif
+}
+
+// read the latency clock
+unsigned long long latencyClock(void)
+{
+#if defined(AVL_LATENCY_RDTSC) && (defined(__x86_64__) || defined(__i386__))
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+#endif
+}
+
+// map a value to its histogram bucket
+static int histogramBucket(unsigned long long value)
+{
+    if (value < AVL_HIST_SUB_BUCKETS)
+        return (int)value;
+
+    int exponent = 63;
+    while (!(value >> exponent))
+        exponent--;
+    int shift = exponent - AVL_HIST_SUB_BITS;
+    int sub = (int)(value >> shift) - AVL_HIST_SUB_BUCKETS;
+    return (shift + 1) * AVL_HIST_SUB_BUCKETS + sub;
+}
+
+// largest value that maps to a bucket
+static unsigned long long histogramBucketMax(int bucket)
+{
+    if (bucket < AVL_HIST_SUB_BUCKETS)
+        return (unsigned long long)bucket;
+
+    int shift = bucket / AVL_HIST_SUB_BUCKETS - 1;
+    unsigned long long sub = (unsigned long long)(bucket % AVL_HIST_SUB_BUCKETS);
+    return ((AVL_HIST_SUB_BUCKETS + sub) << shift) + ((1ULL << shift) - 1);
+}
+
+// clear a histogram
+void histogramReset(AVLHistogram *hist)
+{
+    if (!hist)
+        return;
+    memset(hist, 0, sizeof(*hist));
+    hist->min = ~0ULL;
+}
+
+// record one value
+void histogramRecord(AVLHistogram *hist, unsigned long long value)
+{
+    if (!hist)
+        return;
+    if (hist->total == 0)
+        hist->min = ~0ULL; // also covers zero-initialised histograms
+    hist->counts[histogramBucket(value)]++;
+    hist->total++;
+    hist->sum += value;
+    if (value < hist->min)
+        hist->min = value;
+    if (value > hist->max)
+        hist->max = value;
+}
+
+// add the contents of src into dst (e.g. to combine per-thread histograms)
+void histogramMerge(AVLHistogram *dst, const AVLHistogram *src)
+{
+    if (!dst || !src || src->total == 0)
+        return;
+    if (dst->total == 0)
+        dst->min = ~0ULL;
+    for (int i = 0; i < AVL_HIST_BUCKETS; i++)
+        dst->counts[i] += src->counts[i];
+    dst->total += src->total;
+    dst->sum += src->sum;
+    if (src->min < dst->min)
+        dst->min = src->min;
+    if (src->max > dst->max)
+        dst->max = src->max;
+}
+
+// value at the given percentile (0-100), reported as the bucket's upper bound
+unsigned long long histogramPercentile(const AVLHistogram *hist, double percentile)
+{
+    if (!hist || hist->total == 0)
+        return 0;
+    if (percentile <= 0.0)
+        return hist->min;
+    if (percentile >= 100.0)
+        return hist->max;
+
+    unsigned long long rank = (unsigned long long)(percentile / 100.0 * hist->total + 0.5);
+    if (rank == 0)
+        rank = 1;
+
+    unsigned long long seen = 0;
+    for (int i = 0; i < AVL_HIST_BUCKETS; i++)
+    {
+        seen += hist->counts[i];
+        if (seen >= rank)
+        {
+            unsigned long long value = histogramBucketMax(i);
+            return value < hist->max ? value : hist->max;
+        }
+    }
+    return hist->max;
+}
+
+// print a one-line percentile summary
+void histogramDump(const AVLHistogram *hist, const char *label, FILE *out)
+{
+    if (!hist || !out)
+        return;
+
+    if (hist->total == 0)
+    {
+        fprintf(out, "%-8s count=0\n", label ? label : "");
+        return;
+    }
+
+    fprintf(out, "%-8s count=%llu min=%llu mean=%.1f p50=%llu p90=%llu p99=%llu p99.9=%llu p99.99=%llu max=%llu\n",
+            label ? label : "", hist->total, hist->min, (double)hist->sum / hist->total,
+            histogramPercentile(hist, 50.0), histogramPercentile(hist, 90.0),
+            histogramPercentile(hist, 99.0), histogramPercentile(hist, 99.9),
+            histogramPercentile(hist, 99.99), hist->max);
+}
+
+// select the recorder used by the calling thread
+void setLatencyRecorder(AVLLatencyRecorder *recorder)
+{
+#ifdef AVL_LATENCY
+    latencyRecorder = recorder;
+#else
+    (void)recorder;
+#endif
+}
+
+// clear every histogram of a recorder
+void latencyRecorderReset(AVLLatencyRecorder *recorder)
+{
+    if (!recorder)
+        return;
+    for (int op = 0; op < AVL_OP_COUNT; op++)
+        histogramReset(&recorder->ops[op]);
+}
+
+// add the histograms of src into dst
+void latencyRecorderMerge(AVLLatencyRecorder *dst, const AVLLatencyRecorder *src)
+{
+    if (!dst || !src)
+        return;
+    for (int op = 0; op < AVL_OP_COUNT; op++)
+        histogramMerge(&dst->ops[op], &src->ops[op]);
+}
+
+// print the percentile summary of every operation type
+void latencyRecorderDump(const AVLLatencyRecorder *recorder, FILE *out)
+{
+    static const char *names[AVL_OP_COUNT] = {"insert", "delete", "search"};
+
+    if (!recorder)
+        return;
+    for (int op = 0; op < AVL_OP_COUNT; op++)
+        histogramDump(&recorder->ops[op], names[op], out);
+}
+
+// hash keys with this function in trace events (NULL hashes the data pointer)
+void setTraceKeyHash(hash_func_t hash)
+{
+#ifdef AVL_TRACE
+    __atomic_store_n(&traceKeyHash, hash, __ATOMIC_RELAXED);
+#else
+    (void)hash;
+#endif
+}
+
+#ifdef AVL_TRACE
+// copy one event if its slot still holds it and was not rewritten meanwhile
+static bool traceRead(const AVLTraceBuffer *buf, unsigned long long seq, AVLTraceEvent *out)
+{
+    const AVLTraceEvent *e = &buf->events[(seq - 1) & (AVL_TRACE_CAPACITY - 1)];
+    if (__atomic_load_n(&e->seq, __ATOMIC_ACQUIRE) != seq)
+        return false;
+    *out = *e;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&e->seq, __ATOMIC_RELAXED) == seq;
+}
+
+// first sequence number still held by a buffer ending at head
+static unsigned long long traceFirst(unsigned long long head)
+{
+    return head > AVL_TRACE_CAPACITY ? head - AVL_TRACE_CAPACITY + 1 : 1;
+}
+
+static void traceWrite(int fd, const char *buf, size_t len)
+{
+    while (len)
+    {
+        ssize_t written = write(fd, buf, len);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return;
+        buf += written;
+        len -= (size_t)written;
+    }
+}
+#endif
+
+// copy the calling thread's most recent events, oldest first; returns the number copied
+size_t traceSnapshot(AVLTraceEvent *events, size_t capacity)
+{
+#ifdef AVL_TRACE
+    AVLTraceBuffer *buf = traceBuffer;
+    if (!buf || !events || capacity == 0)
+        return 0;
+
+    unsigned long long head = __atomic_load_n(&buf->head, __ATOMIC_ACQUIRE);
+    unsigned long long seq = traceFirst(head);
+    if (head - seq + 1 > capacity)
+        seq = head - capacity + 1;
+
+    size_t count = 0;
+    for (; seq <= head; seq++)
+        if (traceRead(buf, seq, &events[count]))
+            count++;
+    return count;
+#else
+    (void)events;
+    (void)capacity;
+    return 0;
+#endif
+}
+
+// write every thread's events lasting at least minDuration ticks, one line each;
+// only uses write(2) and never allocates, so it is safe to call from a signal handler
+void traceDumpFd(int fd, unsigned long long minDuration)
+{
+#ifdef AVL_TRACE
+    static const char *names[AVL_OP_COUNT] = {"insert", "delete", "search"};
+
+    for (AVLTraceBuffer *buf = __atomic_load_n(&traceBuffers, __ATOMIC_ACQUIRE); buf; buf = buf->next)
+    {
+        unsigned long long head = __atomic_load_n(&buf->head, __ATOMIC_ACQUIRE);
+        for (unsigned long long seq = traceFirst(head); seq <= head; seq++)
+        {
+            AVLTraceEvent e;
+            if (!traceRead(buf, seq, &e) || e.duration < minDuration || e.op >= AVL_OP_COUNT)
+                continue;
+
+            char line[256];
+            char *p = appendString(line, "thread=");
+            p = appendNumber(p, buf->thread, 10, 0);
+            p = appendString(p, " seq=");
+            p = appendNumber(p, e.seq, 10, 0);
+            p = appendString(p, " op=");
+            p = appendString(p, names[e.op]);
+            p = appendString(p, " start=");
+            p = appendNumber(p, e.timestamp, 10, 0);
+            p = appendString(p, " duration=");
+            p = appendNumber(p, e.duration, 10, 0);
+            p = appendString(p, " depth=");
+            p = appendNumber(p, e.depth, 10, 0);
+            p = appendString(p, " rotations=");
+            p = appendNumber(p, e.rotations, 10, 0);
+            p = appendString(p, " key=");
+            p = appendNumber(p, e.keyHash, 16, 16);
+            *p++ = '\n';
+            traceWrite(fd, line, (size_t)(p - line));
+        }
+    }
+#else
+    (void)fd;
+    (void)minDuration;
+#endif
+}
+
+// FILE wrapper around traceDumpFd
+void traceDump(FILE *out, unsigned long long minDuration)
+{
+    if (!out)
+        return;
+    fflush(out);
+#ifdef AVL_TRACE
+    traceDumpFd(fileno(out), minDuration);
+#else
+    (void)minDuration;
+#endif
+}
+
+#ifdef AVL_TRACE
+static void traceSignalHandler(int signum)
+{
+    (void)signum;
+    int saved = errno;
+    traceDumpFd(STDERR_FILENO, 0);
+    errno = saved;
+}
+#endif
+
+// dump all events to stderr whenever signum arrives; false if tracing is compiled out
+bool traceDumpOnSignal(int signum)
+{
+#ifdef AVL_TRACE
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = traceSignalHandler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    return sigaction(signum, &sa, NULL) == 0;
+#else
+    (void)signum;
+    return false;
+#endif
 }
@@ -13,10 +13,139 @@
 // AVL tree constants
 #define AVL_MAX_BALANCE 1
 
+// relaxed AVL(k) trees let subtree heights differ by up to k (1..AVL_RELAXED_BALANCE_MAX):
+// fewer rotations on writes for a taller tree, at most about 2.5 log2 n levels at k = 4
+#define AVL_RELAXED_BALANCE_MAX 4
+
+// subtree sizes, ranks and counts; -DAVL_LARGE_TREE widens them to 64 bits for trees
+// beyond 2^31 entries, packing size and height into one word so nodes stay the same size
+#ifdef AVL_LARGE_TREE
+#include <stdint.h>
+typedef int64_t avl_size_t;
+#define AVL_SIZE_MAX ((int64_t)(((uint64_t)1 << 47) - 1))
+#else
+typedef int avl_size_t;
+#define AVL_SIZE_MAX INT_MAX
+#endif
+
 // function pointer types for generic operations
 typedef int (*compare_func_t)(const void *a, const void *b);
 typedef void (*print_func_t)(const void *data);
 typedef void (*free_func_t)(void *data);
+typedef size_t (*size_func_t)(const void *data);
+typedef unsigned long long (*hash_func_t)(const void *data);
+typedef unsigned long long (*key_hint_func_t)(const void *data); // order-preserving, see insertHinted
+typedef int (*format_func_t)(char *buf, size_t size, const void *data); // snprintf-style
+typedef int (*visit_func_t)(const void *data, void *context);            // nonzero stops a walk
+
+// traversal orders
+typedef enum AVLOrder
+{
+    AVL_INORDER,
+    AVL_PREORDER,
+    AVL_POSTORDER
+} AVLOrder;
+
+// node layouts for compactTree
+typedef enum AVLLayout
+{
+    AVL_LAYOUT_BFS, // level by level, like an implicit heap
+    AVL_LAYOUT_VEB  // van Emde Boas: recursive top and bottom halves of the height
+} AVLLayout;
+
+// operation types tracked by instrumentation
+typedef enum AVLOpType
+{
+    AVL_OP_INSERT,
+    AVL_OP_DELETE,
+    AVL_OP_SEARCH,
+    AVL_OP_COUNT
+} AVLOpType;
+
+// descent depth (nodes visited) of one operation type
+typedef struct AVLDepthStats
+{
+    unsigned long long count;      // number of operations
+    unsigned long long totalDepth; // nodes visited, summed over all operations
+    unsigned long long maxDepth;   // deepest single operation
+} AVLDepthStats;
+
+// operation counters, only maintained when compiled with -DAVL_STATS
+typedef struct AVLOpStats
+{
+    unsigned long long comparisons;     // comparator calls
+    unsigned long long singleRotations; // single rotations performed by rebalance
+    unsigned long long doubleRotations; // double rotations performed by rebalance
+    unsigned long long allocations;     // nodes allocated
+    unsigned long long frees;           // nodes freed
+    AVLDepthStats depth[AVL_OP_COUNT];  // per-operation descent depth
+} AVLOpStats;
+
+// log-linear latency histogram: values below AVL_HIST_SUB_BUCKETS are exact, larger
+// values fall into one of AVL_HIST_SUB_BUCKETS linear buckets per power of two
+#define AVL_HIST_SUB_BITS 5
+#define AVL_HIST_SUB_BUCKETS (1 << AVL_HIST_SUB_BITS)
+#define AVL_HIST_BUCKETS ((64 - AVL_HIST_SUB_BITS + 1) * AVL_HIST_SUB_BUCKETS)
+
+typedef struct AVLHistogram
+{
+    unsigned long long counts[AVL_HIST_BUCKETS];
+    unsigned long long total; // number of recorded values
+    unsigned long long sum;   // sum of recorded values
+    unsigned long long min;
+    unsigned long long max;
+} AVLHistogram;
+
+// per-operation latencies, recorded by insert/delete/search when compiled with -DAVL_LATENCY
+typedef struct AVLLatencyRecorder
+{
+    AVLHistogram ops[AVL_OP_COUNT];
+} AVLLatencyRecorder;
+
+// one traced operation, recorded by insert/delete/search when compiled with -DAVL_TRACE
+#define AVL_TRACE_CAPACITY 4096 // events kept per thread (a power of two); older ones are overwritten
+
+typedef struct AVLTraceEvent
+{
+    unsigned long long seq;       // 1-based position in the thread's event stream
+    unsigned long long timestamp; // latencyClock() when the operation started
+    unsigned long long duration;  // latencyClock() ticks
+    unsigned long long keyHash;   // hash of the key passed to the operation
+    unsigned int depth;           // nodes visited
+    unsigned short rotations;     // rotations performed (a double rotation counts as two)
+    unsigned char op;             // AVLOpType
+} AVLTraceEvent;
+
+// tree shape and memory footprint, filled by avlStats
+#define AVL_DEPTH_BUCKETS 64 // deeper nodes are counted in the last bucket
+
+typedef struct AVLTreeStats
+{
+    size_t nodeCount;
+    size_t leafCount;
+    size_t nodeBytes;                         // memory used by nodes, with insertKey tails
+    size_t payloadBytes;                      // sum of payload sizes (0 without a size callback)
+    int height;                               // levels in the tree
+    int optimalHeight;                        // ceil(log2(n + 1)), the best possible height
+    double heightRatio;                       // height / optimalHeight
+    unsigned long long totalPathLength;       // sum of node depths (root = 1)
+    double avgPathLength;                     // comparisons of an average successful search
+    double leafRatio;                         // leafCount / nodeCount
+    size_t depthHistogram[AVL_DEPTH_BUCKETS]; // nodes per depth (index 0 = root)
+} AVLTreeStats;
+
+// node arena usage, filled by avlArenaStats (only with -DAVL_NODE_ARENA)
+typedef struct AVLArenaStats
+{
+    size_t chunks;        // chunks mapped so far; they are never returned to the system
+    size_t bytes;         // bytes in those chunks
+    size_t hugetlbBytes;  // in explicit huge pages (MAP_HUGETLB)
+    size_t thpBytes;      // currently in transparent huge pages, read from /proc/self/smaps
+    size_t fallbackBytes; // from malloc, after mmap failed
+    double hugePageRatio; // (hugetlbBytes + thpBytes) / bytes
+    size_t nodesInUse;    // handed out by createNode and not yet released
+    size_t nodesFree;     // released and waiting to be reused
+} AVLArenaStats;
 
 // define AVL node structure
 typedef struct AVLNode
@@ -24,13 +153,85 @@ typedef struct AVLNode
     void *data;            // pointer to data stored in node
     struct AVLNode *left;  // pointer to left child
     struct AVLNode *right; // pointer to right child
-    int height;            // height of this node
+#ifdef AVL_PARENT_POINTERS
+    struct AVLNode *parent; // NULL for the root
+#endif
+#ifdef AVL_LARGE_TREE
+    int64_t size : 48;     // number of nodes in subtree rooted at this node
+    int64_t height : 8;    // height of this node (at most ~70 for 2^47 nodes)
+    uint64_t flags : 8;    // AVL_NODE_* bits
+#else
+    int height : 24;       // height of this node
+    unsigned int flags : 8; // AVL_NODE_* bits
     int size;              // number of nodes in subtree rooted at this node
+#endif
+#ifdef AVL_TOMBSTONES
+    avl_size_t live;       // nodes in the subtree that are not tombstones
+#endif
+#ifdef AVL_KEY_HINTS
+    unsigned long long hint; // key_hint_func_t of data, set by insertHinted
+#endif
 } AVLNode;
 
+// node flags
+#define AVL_NODE_DIRTY 0x1   // subtree holds a node outside the strict AVL balance
+#define AVL_NODE_DELETED 0x2 // tombstone left by tombstoneDelete (-DAVL_TOMBSTONES)
+#define AVL_NODE_BLOCK 0x4   // allocated inside a contiguous block (rebuildSubtree, compactTree)
+#define AVL_NODE_KEY 0x8     // key and value stored in the node's own allocation (insertKey)
+
+// key stored by insertKey right behind its node, in the same allocation or block slot;
+// node->data points at it
+typedef struct AVLKey
+{
+    unsigned long long prefix; // first 8 key bytes, big-endian, zero padded
+    unsigned int length;       // key bytes
+    unsigned int valueLength;  // value bytes, stored after the key
+    unsigned char bytes[];     // key, then value
+} AVLKey;
+
+// with -DAVL_AUTO_REBUILD, relaxed updates rebuild a subtree of at least
+// AVL_REBUILD_MIN_SIZE nodes once it is more than AVL_REBUILD_HEIGHT_RATIO times as tall
+// as a perfectly balanced one. A rebuild moves the subtree's nodes, so any relaxed update
+// may then invalidate node pointers and handles
+#ifndef AVL_REBUILD_HEIGHT_RATIO
+#define AVL_REBUILD_HEIGHT_RATIO 1.5
+#endif
+#ifndef AVL_REBUILD_MIN_SIZE
+#define AVL_REBUILD_MIN_SIZE 64
+#endif
+
+// node blocks of at least this many bytes are aligned to it and, where the system
+// supports it, advised to use transparent huge pages
+#ifndef AVL_HUGE_PAGE_SIZE
+#define AVL_HUGE_PAGE_SIZE ((size_t)2 << 20)
+#endif
+
+// -DAVL_NODE_ARENA carves createNode's nodes out of chunks of this size: explicit
+// huge pages when reserved, else aligned memory advised to use transparent huge pages
+#ifndef AVL_ARENA_CHUNK_SIZE
+#define AVL_ARENA_CHUNK_SIZE AVL_HUGE_PAGE_SIZE
+#endif
+
+
+// tombstone share of a tree above which tombstoneDelete compacts it
+#ifndef AVL_TOMBSTONE_RATIO
+#define AVL_TOMBSTONE_RATIO 0.25
+#endif
+
+// root-to-node path recorded by searchPath and consumed by deletePath; AVL trees
+// of up to 2^47 nodes are less than 70 levels deep
+#define AVL_PATH_MAX 128
+
+typedef struct AVLPath
+{
+    AVLNode *nodes[AVL_PATH_MAX]; // nodes[0] is the root, nodes[length - 1] the match
+    int length;
+} AVLPath;
+
 // basic operations
 int getHeight(const AVLNode *node);
-int getSize(const AVLNode *node);
+avl_size_t getSize(const AVLNode *node);
+avl_size_t getLiveSize(const AVLNode *node); // getSize without tombstones
 int getBalance(const AVLNode *node);
 void updateHeight(AVLNode *node);
 void updateSize(AVLNode *node);
@@ -47,7 +248,61 @@ AVLNode *delete(AVLNode *node, void *data, compare_func_t compare, free_func_t f
 AVLNode *search(AVLNode *node, void *data, compare_func_t compare);
 AVLNode *findMin(AVLNode *node);
 AVLNode *findMax(AVLNode *node);
-AVLNode *createAVLFromArray(void *arr[], int size, compare_func_t compare);
+AVLNode *createAVLFromArray(void *arr[], avl_size_t size, compare_func_t compare);
+
+// delete without a second descent: searchPath records where the key is, deletePath
+// removes it with no comparator calls; removeMin detaches the smallest node
+AVLNode *searchPath(AVLNode *root, void *data, compare_func_t compare, AVLPath *path);
+AVLNode *deletePath(AVLNode *root, AVLPath *path, free_func_t free_data);
+AVLNode *removeMin(AVLNode *root, AVLNode **min);
+
+// AVL(k) variants: maxBalance is the tree's allowed height difference, clamped to
+// 1..AVL_RELAXED_BALANCE_MAX; every update of a tree must use the same value
+AVLNode *rebalanceRelaxed(AVLNode *node, int maxBalance);
+AVLNode *insertRelaxed(AVLNode *node, void *data, compare_func_t compare, int maxBalance);
+AVLNode *deleteRelaxed(AVLNode *node, void *data, compare_func_t compare, free_func_t free_data, int maxBalance);
+
+// deferred rebalancing: relaxed updates mark subtrees that are out of strict AVL
+// balance, and rebalanceAll restores the AVL invariant in one pass over those marks
+AVLNode *rebalanceAll(AVLNode *root);
+bool needsRebalance(const AVLNode *root);
+
+// partial rebuild: flatten a subtree and relink it perfectly balanced, its nodes moved
+// into one contiguous block; relaxed updates call it on subtrees that grow too tall
+AVLNode *rebuildSubtree(AVLNode *node);
+
+// defragmentation: move every node into one contiguous block in the given layout,
+// keeping the tree's shape; the tree stays an ordinary, mutable tree afterwards
+AVLNode *compactTree(AVLNode *root, AVLLayout layout);
+
+// weak AVL (WAVL) trees keep a rank in the height field: AVL shape without deletes,
+// at most one single or double rotation per delete; use only these to update them
+AVLNode *wavlInsert(AVLNode *node, void *data, compare_func_t compare);
+AVLNode *wavlDelete(AVLNode *node, void *data, compare_func_t compare, free_func_t free_data);
+
+// single-allocation nodes: insertKey copies the key bytes and an optional value into the
+// node's allocation, so an insert allocates once and comparisons read memory next to the
+// node. Update such a tree only with these; avlKeyCompare orders its AVLKeys for queries
+AVLNode *insertKey(AVLNode *root, const void *key, size_t length, const void *value, size_t valueLength);
+AVLNode *searchKey(AVLNode *root, const void *key, size_t length);
+AVLNode *deleteKey(AVLNode *root, const void *key, size_t length);
+int avlKeyCompare(const void *a, const void *b);
+void *avlKeyValue(const AVLNode *node);
+
+#ifdef AVL_TOMBSTONES
+// lazy deletes, only with -DAVL_TOMBSTONES: a tombstone keeps its node and data but is
+// skipped by searches, queries and visitors; re-inserting its key revives it in place
+AVLNode *tombstoneDelete(AVLNode *root, void *data, compare_func_t compare, free_func_t free_data);
+AVLNode *insertRevive(AVLNode *root, void *data, compare_func_t compare, free_func_t free_data);
+AVLNode *compactTombstones(AVLNode *root, free_func_t free_data);
+#endif
+
+#ifdef AVL_PARENT_POINTERS
+// handle-based operations, only with -DAVL_PARENT_POINTERS
+AVLNode *avlNext(const AVLNode *node);
+AVLNode *avlPrev(const AVLNode *node);
+AVLNode *deleteNode(AVLNode *root, AVLNode *node, free_func_t free_data);
+#endif
 
 // utility functions
 void printAVL(const AVLNode *root, const char *prefix, bool isLast, print_func_t print_data);
@@ -55,17 +310,68 @@ void inorderTraversal(const AVLNode *root, print_func_t print_data);
 void preorderTraversal(const AVLNode *root, print_func_t print_data);
 void postorderTraversal(const AVLNode *root, print_func_t print_data);
 void freeAVLTree(AVLNode *root, free_func_t free_data);
+int visitAVL(const AVLNode *root, AVLOrder order, visit_func_t visit, void *context);
+int visitAVLMorris(AVLNode *root, visit_func_t visit, void *context); // threads the tree while walking
+
+// buffered output to a FILE or file descriptor; false if a write failed
+bool dumpAVL(const AVLNode *root, FILE *out, format_func_t format);
+bool dumpAVLFd(const AVLNode *root, int fd, format_func_t format);
+bool dumpTraversal(const AVLNode *root, AVLOrder order, FILE *out, format_func_t format);
+bool dumpTraversalFd(const AVLNode *root, AVLOrder order, int fd, format_func_t format);
 
 // validation functions
 bool isValidBST(const AVLNode *root, void *minVal, void *maxVal, compare_func_t compare);
 bool isValidAVL(const AVLNode *root);
+bool isValidAVLRelaxed(const AVLNode *root, int maxBalance);
+bool isValidWAVL(const AVLNode *root);
+
+// key hints (-DAVL_KEY_HINTS): the node caches hint(data), and descents compare hints
+// before calling compare, which then only runs on a tie. hint must preserve the order:
+// compare(a, b) <= 0 implies hint(a) <= hint(b). Build such a tree with insertHinted;
+// any delete works. Without the flag these are insert, search and rangeQuery
+AVLNode *insertHinted(AVLNode *root, void *data, compare_func_t compare, key_hint_func_t hint);
+AVLNode *searchHinted(AVLNode *root, void *data, compare_func_t compare, key_hint_func_t hint);
+void rangeQueryHinted(const AVLNode *root, void *minVal, void *maxVal, compare_func_t compare, key_hint_func_t hint,
+                      void (*callback)(const void *data, void *context), void *context);
 
 // query functions
 void rangeQuery(const AVLNode *root, void *minVal, void *maxVal, compare_func_t compare,
                 void (*callback)(const void *data, void *context), void *context);
-int countRange(const AVLNode *root, void *minVal, void *maxVal, compare_func_t compare);
-AVLNode *findKthSmallest(AVLNode *root, int k);
-AVLNode *findKthLargest(AVLNode *root, int k);
-int getRank(const AVLNode *root, void *data, compare_func_t compare);
+void rangeQueryMorris(AVLNode *root, void *minVal, void *maxVal, compare_func_t compare,
+                      void (*callback)(const void *data, void *context), void *context);
+avl_size_t countRange(const AVLNode *root, void *minVal, void *maxVal, compare_func_t compare);
+AVLNode *findKthSmallest(AVLNode *root, avl_size_t k);
+AVLNode *findKthLargest(AVLNode *root, avl_size_t k);
+avl_size_t getRank(const AVLNode *root, void *data, compare_func_t compare);
+
+// shape statistics (threads > 1 splits large trees across worker threads)
+void avlStats(const AVLNode *root, size_func_t payload_size, AVLTreeStats *stats);
+void avlStatsParallel(const AVLNode *root, size_func_t payload_size, AVLTreeStats *stats, int threads);
+
+// node arena statistics; false (and zeroed) unless compiled with -DAVL_NODE_ARENA
+bool avlArenaStats(AVLArenaStats *stats);
+
+// instrumentation (counters stay zero unless compiled with -DAVL_STATS; not thread-safe)
+void getOpStats(AVLOpStats *stats);
+void resetOpStats(void);
+
+// latency histograms (ticks are nanoseconds, or TSC cycles with -DAVL_LATENCY_RDTSC)
+unsigned long long latencyClock(void);
+void histogramReset(AVLHistogram *hist);
+void histogramRecord(AVLHistogram *hist, unsigned long long value);
+void histogramMerge(AVLHistogram *dst, const AVLHistogram *src);
+unsigned long long histogramPercentile(const AVLHistogram *hist, double percentile);
+void histogramDump(const AVLHistogram *hist, const char *label, FILE *out);
+void setLatencyRecorder(AVLLatencyRecorder *recorder); // per thread, NULL to stop recording
+void latencyRecorderReset(AVLLatencyRecorder *recorder);
+void latencyRecorderMerge(AVLLatencyRecorder *dst, const AVLLatencyRecorder *src);
+void latencyRecorderDump(const AVLLatencyRecorder *recorder, FILE *out);
+
+// operation tracing (per-thread ring buffers, empty unless compiled with -DAVL_TRACE)
+void setTraceKeyHash(hash_func_t hash);
+size_t traceSnapshot(AVLTraceEvent *events, size_t capacity);
+void traceDump(FILE *out, unsigned long long minDuration);
+void traceDumpFd(int fd, unsigned long long minDuration); // async-signal-safe
+bool traceDumpOnSignal(int signum);
 
 #endif // AVL_H
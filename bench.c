@@ -0,0 +1,714 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "AVL.h"
+#include "bench_perf.h"
+#include "bench_random.h"
+#include "bench_scale.h"
+#include "bench_structs.h"
+#include "bench_trace.h"
+#include <stdint.h>
+#include <time.h>
+
+// === Data Helper Functions ===
+static int int_compare(const void *a, const void *b)
+{
+    int ia = *(const int *)a, ib = *(const int *)b;
+    return (ia > ib) - (ia < ib);
+}
+
+static void *xmalloc(size_t size)
+{
+    void *ptr = malloc(size);
+    if (!ptr)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+// === Timing ===
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// === Benchmark Configuration ===
+typedef enum
+{
+    FORMAT_TEXT,
+    FORMAT_CSV,
+    FORMAT_JSON
+} OutputFormat;
+
+typedef enum
+{
+    WORKLOAD_SEQUENTIAL,
+    WORKLOAD_RANDOM,
+    WORKLOAD_ZIPF,
+    WORKLOAD_MIXED,
+    WORKLOAD_READ_HEAVY,
+    WORKLOAD_WRITE_HEAVY,
+    WORKLOAD_COUNT
+} Workload;
+
+static const char *workload_names[WORKLOAD_COUNT] = {"sequential", "random", "zipf", "mixed",
+                                                     "read-heavy", "write-heavy"};
+
+#define MAX_SIZES 16
+#define READ_HEAVY_PCT 95
+#define WRITE_HEAVY_PCT 10
+
+typedef struct
+{
+    int sizes[MAX_SIZES];
+    int size_count;
+    int ops;                      // operations per measured phase (0 = size, capped)
+    bool workloads[WORKLOAD_COUNT];
+    const OrderedSet *structures[ORDERED_SET_MAX];
+    int structure_count;
+    int range_width;              // keys covered by each rangeQuery/countRange
+    int read_pct;                 // share of searches in the mixed workload
+    double zipf_theta;
+    uint64_t seed;
+    bool perf;                    // sample hardware counters per phase
+    OutputFormat format;
+    FILE *out;
+} BenchConfig;
+
+// === Result Reporting ===
+typedef struct
+{
+    const char *workload;
+    const char *structure;
+    const char *op;
+    int size;
+    long ops;
+    double seconds;
+    AVLOpStats stats;        // operation counters (zero unless built with AVL_STATS)
+    AVLHistogram latency;    // per-call latencies (empty unless built with AVL_LATENCY)
+    PerfSample perf;         // hardware counters for the whole phase
+} BenchResult;
+
+static int result_count = 0;
+
+// throughput of every result, kept for the cross-structure summary
+typedef struct
+{
+    const char *workload, *structure, *op;
+    int size;
+    double ops_per_sec;
+} SummaryEntry;
+
+static SummaryEntry *summary = NULL;
+static int summary_count = 0, summary_capacity = 0;
+
+#ifdef AVL_STATS
+// per-operation averages of the instrumentation counters
+static void stats_per_op(const BenchResult *r, double *cmp, double *rot, double *depth)
+{
+    const AVLOpStats *s = &r->stats;
+    unsigned long long visits = 0, descents = 0;
+    for (int op = 0; op < AVL_OP_COUNT; op++)
+    {
+        visits += s->depth[op].totalDepth;
+        descents += s->depth[op].count;
+    }
+    *cmp = r->ops > 0 ? (double)s->comparisons / r->ops : 0.0;
+    *rot = r->ops > 0 ? (double)(s->singleRotations + s->doubleRotations) / r->ops : 0.0;
+    *depth = descents > 0 ? (double)visits / descents : 0.0;
+}
+#endif
+
+// hardware counter columns, per operation
+static const char *perf_text_headers[PERF_COUNTER_COUNT] = {"cyc/op", "ins/op", "miss/op", "brmiss/op"};
+
+static void report_perf(const BenchConfig *cfg, const BenchResult *r)
+{
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+    {
+        double per_op = r->ops > 0 ? (double)r->perf.values[i] / r->ops : 0.0;
+        switch (cfg->format)
+        {
+        case FORMAT_TEXT:
+            if (r->perf.valid[i])
+                fprintf(cfg->out, " %9.2f", per_op);
+            else
+                fprintf(cfg->out, " %9s", "n/a");
+            break;
+        case FORMAT_CSV:
+            if (r->perf.valid[i])
+                fprintf(cfg->out, ",%.3f", per_op);
+            else
+                fputc(',', cfg->out);
+            break;
+        case FORMAT_JSON:
+            if (r->perf.valid[i])
+                fprintf(cfg->out, ", \"%s_per_op\": %.3f", perf_counter_names[i], per_op);
+            else
+                fprintf(cfg->out, ", \"%s_per_op\": null", perf_counter_names[i]);
+            break;
+        }
+    }
+}
+
+static void report_perf_header(const BenchConfig *cfg)
+{
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+    {
+        if (cfg->format == FORMAT_TEXT)
+            fprintf(cfg->out, " %9s", perf_text_headers[i]);
+        else if (cfg->format == FORMAT_CSV)
+            fprintf(cfg->out, ",%s_per_op", perf_counter_names[i]);
+    }
+}
+
+static void report(const BenchConfig *cfg, const BenchResult *r)
+{
+    double ops_per_sec = r->seconds > 0 ? r->ops / r->seconds : 0.0;
+    double ns_per_op = r->ops > 0 ? r->seconds * 1e9 / r->ops : 0.0;
+#ifdef AVL_STATS
+    double cmp, rot, depth;
+    stats_per_op(r, &cmp, &rot, &depth);
+#endif
+#ifdef AVL_LATENCY
+    unsigned long long p50 = histogramPercentile(&r->latency, 50.0);
+    unsigned long long p99 = histogramPercentile(&r->latency, 99.0);
+    unsigned long long p999 = histogramPercentile(&r->latency, 99.9);
+#endif
+
+    switch (cfg->format)
+    {
+    case FORMAT_TEXT:
+        if (result_count == 0)
+        {
+            fprintf(cfg->out, "%-11s %-9s %-16s %10s %10s %14s %10s",
+                    "workload", "structure", "op", "size", "ops", "ops/sec", "ns/op");
+#ifdef AVL_STATS
+            fprintf(cfg->out, " %8s %8s %8s", "cmp/op", "rot/op", "depth");
+#endif
+#ifdef AVL_LATENCY
+            fprintf(cfg->out, " %8s %8s %8s", "p50", "p99", "p99.9");
+#endif
+            if (cfg->perf)
+                report_perf_header(cfg);
+            fputc('\n', cfg->out);
+        }
+        fprintf(cfg->out, "%-11s %-9s %-16s %10d %10ld %14.0f %10.1f",
+                r->workload, r->structure, r->op, r->size, r->ops, ops_per_sec, ns_per_op);
+#ifdef AVL_STATS
+        fprintf(cfg->out, " %8.2f %8.3f %8.2f", cmp, rot, depth);
+#endif
+#ifdef AVL_LATENCY
+        fprintf(cfg->out, " %8llu %8llu %8llu", p50, p99, p999);
+#endif
+        if (cfg->perf)
+            report_perf(cfg, r);
+        fputc('\n', cfg->out);
+        break;
+    case FORMAT_CSV:
+        if (result_count == 0)
+        {
+            fprintf(cfg->out, "workload,structure,op,size,ops,seconds,ops_per_sec,ns_per_op");
+#ifdef AVL_STATS
+            fprintf(cfg->out, ",cmp_per_op,rot_per_op,avg_depth");
+#endif
+#ifdef AVL_LATENCY
+            fprintf(cfg->out, ",p50,p99,p999");
+#endif
+            if (cfg->perf)
+                report_perf_header(cfg);
+            fputc('\n', cfg->out);
+        }
+        fprintf(cfg->out, "%s,%s,%s,%d,%ld,%.9f,%.1f,%.2f",
+                r->workload, r->structure, r->op, r->size, r->ops, r->seconds, ops_per_sec, ns_per_op);
+#ifdef AVL_STATS
+        fprintf(cfg->out, ",%.3f,%.4f,%.3f", cmp, rot, depth);
+#endif
+#ifdef AVL_LATENCY
+        fprintf(cfg->out, ",%llu,%llu,%llu", p50, p99, p999);
+#endif
+        if (cfg->perf)
+            report_perf(cfg, r);
+        fputc('\n', cfg->out);
+        break;
+    case FORMAT_JSON:
+        fprintf(cfg->out, "%s\n  {\"workload\": \"%s\", \"structure\": \"%s\", \"op\": \"%s\", "
+                          "\"size\": %d, \"ops\": %ld, \"seconds\": %.9f, \"ops_per_sec\": %.1f, \"ns_per_op\": %.2f",
+                result_count == 0 ? "[" : ",", r->workload, r->structure, r->op, r->size, r->ops,
+                r->seconds, ops_per_sec, ns_per_op);
+#ifdef AVL_STATS
+        fprintf(cfg->out, ", \"cmp_per_op\": %.3f, \"rot_per_op\": %.4f, \"avg_depth\": %.3f",
+                cmp, rot, depth);
+#endif
+#ifdef AVL_LATENCY
+        fprintf(cfg->out, ", \"p50\": %llu, \"p99\": %llu, \"p999\": %llu", p50, p99, p999);
+#endif
+        if (cfg->perf)
+            report_perf(cfg, r);
+        fputc('}', cfg->out);
+        break;
+    }
+    result_count++;
+
+    if (summary_count == summary_capacity)
+    {
+        summary_capacity = summary_capacity ? 2 * summary_capacity : 64;
+        summary = realloc(summary, summary_capacity * sizeof(SummaryEntry));
+        if (!summary)
+        {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    summary[summary_count++] = (SummaryEntry){r->workload, r->structure, r->op, r->size, ops_per_sec};
+}
+
+// fastest structure for every (size, workload, op), with its lead over the AVL tree
+static void report_summary(const BenchConfig *cfg)
+{
+    fprintf(cfg->out, "\nFastest structure per operation\n");
+    fprintf(cfg->out, "%-11s %-16s %10s %-9s %14s %10s\n",
+            "workload", "op", "size", "fastest", "ops/sec", "vs avl");
+    for (int i = 0; i < summary_count; i++)
+    {
+        const SummaryEntry *e = &summary[i], *best = e, *avl = NULL;
+        bool first = true;
+        for (int j = 0; j < summary_count; j++)
+        {
+            const SummaryEntry *o = &summary[j];
+            if (o->size != e->size || strcmp(o->workload, e->workload) || strcmp(o->op, e->op))
+                continue;
+            if (j < i)
+                first = false;
+            if (o->ops_per_sec > best->ops_per_sec)
+                best = o;
+            if (strcmp(o->structure, "avl") == 0)
+                avl = o;
+        }
+        if (!first)
+            continue;
+
+        fprintf(cfg->out, "%-11s %-16s %10d %-9s %14.0f", e->workload, e->op, e->size,
+                best->structure, best->ops_per_sec);
+        if (avl && avl->ops_per_sec > 0)
+            fprintf(cfg->out, " %9.2fx\n", best->ops_per_sec / avl->ops_per_sec);
+        else
+            fprintf(cfg->out, " %10s\n", "n/a");
+    }
+}
+
+static void report_finish(const BenchConfig *cfg)
+{
+    if (cfg->format == FORMAT_JSON)
+        fprintf(cfg->out, result_count ? "\n]\n" : "[]\n");
+    else if (cfg->format == FORMAT_TEXT && cfg->structure_count > 1)
+        report_summary(cfg);
+    free(summary);
+}
+
+// === Workload Phases ===
+static AVLLatencyRecorder recorder; // filled by insert/delete/search with AVL_LATENCY
+static PerfCounters perf;          // hardware counters, unused fds are -1
+
+static double phase_begin(void)
+{
+    resetOpStats();
+    latencyRecorderReset(&recorder);
+    double start = now_seconds();
+    perf_start(&perf);
+    return start;
+}
+
+static void phase_end(const BenchConfig *cfg, BenchResult *r, const char *op, long ops, double start)
+{
+    perf_stop(&perf, &r->perf);
+    r->seconds = now_seconds() - start;
+    r->op = op;
+    r->ops = ops;
+    getOpStats(&r->stats);
+    histogramReset(&r->latency);
+    for (int i = 0; i < AVL_OP_COUNT; i++)
+        histogramMerge(&r->latency, &recorder.ops[i]);
+    report(cfg, r);
+}
+
+static volatile long sink; // keeps query results observable
+
+static void count_callback(const void *data, void *context)
+{
+    (void)data;
+    (*(long *)context)++;
+}
+
+// query keys for a workload: sequential walks the key space, random is uniform and
+// zipf concentrates on a scrambled set of hot keys
+static int *make_query_keys(const BenchConfig *cfg, Workload w, int n, int ops)
+{
+    int *keys = xmalloc(ops * sizeof(int));
+    if (w == WORKLOAD_ZIPF)
+    {
+        Zipf z;
+        zipf_init(&z, n, cfg->zipf_theta);
+        for (int i = 0; i < ops; i++)
+            keys[i] = (int)(((uint64_t)zipf_next(&z) * 2654435761ULL) % (uint64_t)n);
+    }
+    else
+    {
+        for (int i = 0; i < ops; i++)
+            keys[i] = w == WORKLOAD_SEQUENTIAL ? i % n : rng_below(n);
+    }
+    return keys;
+}
+
+static void run_phased(const BenchConfig *cfg, const OrderedSet *os, Workload w, int n, int ops, int *pool)
+{
+    BenchResult r = {.workload = workload_names[w], .structure = os->name, .size = n};
+    void *set = os->create(int_compare);
+    bool writes = os->max_write_size == 0 || n <= os->max_write_size;
+
+    // insertion order: ascending for sequential, shuffled otherwise
+    int *order = xmalloc(n * sizeof(int));
+    for (int i = 0; i < n; i++)
+        order[i] = i;
+    if (w != WORKLOAD_SEQUENTIAL)
+        shuffle(order, n);
+
+    if (writes)
+    {
+        double t = phase_begin();
+        for (int i = 0; i < n; i++)
+            os->insert(set, &pool[order[i]]);
+        phase_end(cfg, &r, "insert", n, t);
+    }
+    else
+    {
+        // too slow to measure at this size: build in ascending order instead
+        for (int i = 0; i < n; i++)
+            os->insert(set, &pool[i]);
+    }
+
+    int *keys = make_query_keys(cfg, w, n, ops);
+    long acc = 0;
+
+    double t = phase_begin();
+    for (int i = 0; i < ops; i++)
+        acc += os->search(set, &pool[keys[i]]) != NULL;
+    phase_end(cfg, &r, "search", ops, t);
+
+    t = phase_begin();
+    for (int i = 0; i < ops; i++)
+    {
+        int hi = keys[i] + cfg->range_width - 1;
+        os->range(set, &pool[keys[i]], &pool[hi < n ? hi : n - 1], count_callback, &acc);
+    }
+    phase_end(cfg, &r, "rangeQuery", ops, t);
+
+    if (os->count_range)
+    {
+        t = phase_begin();
+        for (int i = 0; i < ops; i++)
+        {
+            int hi = keys[i] + cfg->range_width - 1;
+            acc += os->count_range(set, &pool[keys[i]], &pool[hi < n ? hi : n - 1]);
+        }
+        phase_end(cfg, &r, "countRange", ops, t);
+    }
+
+    if (os->rank)
+    {
+        t = phase_begin();
+        for (int i = 0; i < ops; i++)
+            acc += os->rank(set, &pool[keys[i]]);
+        phase_end(cfg, &r, "getRank", ops, t);
+    }
+
+    if (os->kth)
+    {
+        t = phase_begin();
+        for (int i = 0; i < ops; i++)
+            acc += os->kth(set, keys[i] + 1) != NULL;
+        phase_end(cfg, &r, "findKthSmallest", ops, t);
+    }
+
+    // delete everything, in the same order the keys went in
+    if (writes)
+    {
+        t = phase_begin();
+        for (int i = 0; i < n; i++)
+            os->remove(set, &pool[order[i]]);
+        phase_end(cfg, &r, "delete", n, t);
+    }
+
+    sink = acc;
+    os->destroy(set);
+    free(keys);
+    free(order);
+}
+
+// mixed read/write: the set starts with every other key of [0, 2n) and random keys
+// from the whole space are searched, inserted or deleted
+static void run_mixed(const BenchConfig *cfg, const OrderedSet *os, Workload w, int read_pct,
+                      int n, int ops, int *pool)
+{
+    if (os->max_write_size && n > os->max_write_size)
+        return;
+
+    void *set = os->create(int_compare);
+    for (int i = 0; i < 2 * n; i += 2)
+        os->insert(set, &pool[i]);
+
+    int write_pct = 100 - read_pct;
+    long acc = 0;
+    double t = phase_begin();
+    for (int i = 0; i < ops; i++)
+    {
+        int key = rng_below(2 * n);
+        int dice = rng_below(100);
+        if (dice < read_pct)
+            acc += os->search(set, &pool[key]) != NULL;
+        else if (dice < read_pct + write_pct / 2)
+            os->insert(set, &pool[key]);
+        else
+            os->remove(set, &pool[key]);
+    }
+    BenchResult r = {.workload = workload_names[w], .structure = os->name, .size = n};
+    phase_end(cfg, &r, "mixed", ops, t);
+
+    sink = acc;
+    os->destroy(set);
+}
+
+// === Command Line ===
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "       %s generate --output=FILE [options]   write a workload trace\n"
+            "       %s replay FILE [options]              replay a trace with timing\n"
+            "       %s scale [options]                    memory scaling at 10M-500M nodes\n"
+            "  --sizes=N[,N...]      tree sizes to benchmark (default 1000,100000,1000000)\n"
+            "  --ops=N               operations per measured phase (default: size, max 1000000)\n"
+            "  --workloads=LIST      any of sequential,random,zipf,mixed,read-heavy,write-heavy\n"
+            "                        (default: all)\n"
+            "  --structures=LIST     any of avl,avl2,avl3,avl-lazy,wavl,rbtree,skiplist,bptree,\n"
+            "                        sorted (avl-tomb with AVL_TOMBSTONES), or all (default avl)\n"
+            "  --range-width=N       keys covered by range queries (default 100)\n"
+            "  --read-pct=N          search percentage in the mixed workload (default 50)\n"
+            "  --zipf-theta=X        zipfian skew (default 0.99)\n"
+            "  --seed=N              random seed\n"
+            "  --perf=on|off         sample hardware counters via perf_event_open (default on)\n"
+            "  --format=FMT          text, csv or json (default text)\n"
+            "  --output=FILE         write results to FILE instead of stdout\n",
+            prog, prog, prog, prog);
+}
+
+static bool parse_sizes(BenchConfig *cfg, const char *list)
+{
+    cfg->size_count = 0;
+    char *copy = xmalloc(strlen(list) + 1);
+    strcpy(copy, list);
+    for (char *tok = strtok(copy, ","); tok; tok = strtok(NULL, ","))
+    {
+        long v = strtol(tok, NULL, 10);
+        if (v <= 0 || v > INT_MAX / 2 || cfg->size_count == MAX_SIZES)
+        {
+            free(copy);
+            return false;
+        }
+        cfg->sizes[cfg->size_count++] = (int)v;
+    }
+    free(copy);
+    return cfg->size_count > 0;
+}
+
+static bool parse_workloads(BenchConfig *cfg, const char *list)
+{
+    memset(cfg->workloads, 0, sizeof(cfg->workloads));
+    char *copy = xmalloc(strlen(list) + 1);
+    strcpy(copy, list);
+    bool ok = true;
+    for (char *tok = strtok(copy, ","); tok && ok; tok = strtok(NULL, ","))
+    {
+        ok = false;
+        for (int w = 0; w < WORKLOAD_COUNT; w++)
+            if (strcmp(tok, workload_names[w]) == 0)
+                cfg->workloads[w] = ok = true;
+    }
+    free(copy);
+    return ok;
+}
+
+static bool parse_structures(BenchConfig *cfg, const char *list)
+{
+    cfg->structure_count = 0;
+    if (strcmp(list, "all") == 0)
+    {
+        for (int i = 0; i < ordered_set_count && i < ORDERED_SET_MAX; i++)
+            cfg->structures[cfg->structure_count++] = &ordered_sets[i];
+        return true;
+    }
+
+    char *copy = xmalloc(strlen(list) + 1);
+    strcpy(copy, list);
+    bool ok = true;
+    for (char *tok = strtok(copy, ","); tok && ok; tok = strtok(NULL, ","))
+    {
+        const OrderedSet *os = find_ordered_set(tok);
+        ok = os && cfg->structure_count < ORDERED_SET_MAX;
+        if (ok)
+            cfg->structures[cfg->structure_count++] = os;
+    }
+    free(copy);
+    return ok && cfg->structure_count > 0;
+}
+
+static bool parse_args(BenchConfig *cfg, int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const char *val = strchr(arg, '=');
+        if (!val)
+            return false;
+        val++;
+
+        if (strncmp(arg, "--sizes=", 8) == 0)
+        {
+            if (!parse_sizes(cfg, val))
+                return false;
+        }
+        else if (strncmp(arg, "--ops=", 6) == 0)
+            cfg->ops = atoi(val);
+        else if (strncmp(arg, "--workloads=", 12) == 0)
+        {
+            if (!parse_workloads(cfg, val))
+                return false;
+        }
+        else if (strncmp(arg, "--structures=", 13) == 0)
+        {
+            if (!parse_structures(cfg, val))
+                return false;
+        }
+        else if (strncmp(arg, "--range-width=", 14) == 0)
+            cfg->range_width = atoi(val);
+        else if (strncmp(arg, "--read-pct=", 11) == 0)
+            cfg->read_pct = atoi(val);
+        else if (strncmp(arg, "--zipf-theta=", 13) == 0)
+            cfg->zipf_theta = atof(val);
+        else if (strncmp(arg, "--seed=", 7) == 0)
+            cfg->seed = strtoull(val, NULL, 10);
+        else if (strncmp(arg, "--perf=", 7) == 0)
+        {
+            if (strcmp(val, "on") != 0 && strcmp(val, "off") != 0)
+                return false;
+            cfg->perf = strcmp(val, "on") == 0;
+        }
+        else if (strncmp(arg, "--format=", 9) == 0)
+        {
+            if (strcmp(val, "text") == 0)
+                cfg->format = FORMAT_TEXT;
+            else if (strcmp(val, "csv") == 0)
+                cfg->format = FORMAT_CSV;
+            else if (strcmp(val, "json") == 0)
+                cfg->format = FORMAT_JSON;
+            else
+                return false;
+        }
+        else if (strncmp(arg, "--output=", 9) == 0)
+        {
+            cfg->out = fopen(val, "w");
+            if (!cfg->out)
+            {
+                perror(val);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else
+            return false;
+    }
+
+    return cfg->ops >= 0 && cfg->range_width > 0 && cfg->read_pct >= 0 &&
+           cfg->read_pct <= 100 && cfg->zipf_theta > 0.0 && cfg->zipf_theta < 1.0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "generate") == 0)
+        return trace_generate_main(argc - 1, argv + 1);
+    if (argc > 1 && strcmp(argv[1], "replay") == 0)
+        return trace_replay_main(argc - 1, argv + 1);
+    if (argc > 1 && strcmp(argv[1], "scale") == 0)
+        return scale_main(argc - 1, argv + 1);
+
+    BenchConfig cfg = {
+        .sizes = {1000, 100000, 1000000},
+        .size_count = 3,
+        .ops = 0,
+        .workloads = {true, true, true, true, true, true},
+        .structures = {&ordered_sets[0]},
+        .structure_count = 1,
+        .range_width = 100,
+        .read_pct = 50,
+        .zipf_theta = 0.99,
+        .seed = 42,
+        .perf = true,
+        .format = FORMAT_TEXT,
+        .out = stdout,
+    };
+
+    if (!parse_args(&cfg, argc, argv))
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    setLatencyRecorder(&recorder);
+
+    if (!cfg.perf)
+        for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+            perf.fds[i] = -1;
+    else if (!perf_open(&perf))
+        fprintf(stderr, "note: hardware counters unavailable (perf_event_open failed, "
+                        "check /proc/sys/kernel/perf_event_paranoid)\n");
+
+    for (int s = 0; s < cfg.size_count; s++)
+    {
+        int n = cfg.sizes[s];
+        int ops = cfg.ops > 0 ? cfg.ops : (n < 1000000 ? n : 1000000);
+
+        // every tree stores pointers into one contiguous key pool, so payload
+        // allocation does not pollute the measurements
+        int *pool = xmalloc(2 * (size_t)n * sizeof(int));
+        for (int i = 0; i < 2 * n; i++)
+            pool[i] = i;
+
+        for (int w = 0; w < WORKLOAD_COUNT; w++)
+        {
+            if (!cfg.workloads[w])
+                continue;
+            for (int st = 0; st < cfg.structure_count; st++)
+            {
+                const OrderedSet *os = cfg.structures[st];
+                rng_seed(cfg.seed + (uint64_t)w); // same key sequence for every structure
+                if (w == WORKLOAD_MIXED)
+                    run_mixed(&cfg, os, (Workload)w, cfg.read_pct, n, ops, pool);
+                else if (w == WORKLOAD_READ_HEAVY)
+                    run_mixed(&cfg, os, (Workload)w, READ_HEAVY_PCT, n, ops, pool);
+                else if (w == WORKLOAD_WRITE_HEAVY)
+                    run_mixed(&cfg, os, (Workload)w, WRITE_HEAVY_PCT, n, ops, pool);
+                else
+                    run_phased(&cfg, os, (Workload)w, n, ops, pool);
+            }
+        }
+
+        free(pool);
+    }
+
+    report_finish(&cfg);
+    perf_close(&perf);
+    if (cfg.out != stdout)
+        fclose(cfg.out);
+    return EXIT_SUCCESS;
+}
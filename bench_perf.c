@@ -0,0 +1,110 @@
+#define _GNU_SOURCE
+
+#include "bench_perf.h"
+#include <string.h>
+
+const char *perf_counter_names[PERF_COUNTER_COUNT] = {"cycles", "instructions", "cache_misses", "branch_misses"};
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static const uint64_t perf_configs[PERF_COUNTER_COUNT] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+static int perf_event_open(struct perf_event_attr *attr)
+{
+    return (int)syscall(SYS_perf_event_open, attr, 0, -1, -1, 0);
+}
+
+// each counter is opened on its own so a missing one does not disable the rest
+bool perf_open(PerfCounters *pc)
+{
+    bool any = false;
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+    {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = perf_configs[i];
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        pc->fds[i] = perf_event_open(&attr);
+        any |= pc->fds[i] >= 0;
+    }
+    return any;
+}
+
+void perf_start(PerfCounters *pc)
+{
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+    {
+        if (pc->fds[i] < 0)
+            continue;
+        ioctl(pc->fds[i], PERF_EVENT_IOC_RESET, 0);
+        ioctl(pc->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+void perf_stop(PerfCounters *pc, PerfSample *sample)
+{
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+    {
+        sample->valid[i] = false;
+        sample->values[i] = 0;
+        if (pc->fds[i] < 0)
+            continue;
+        ioctl(pc->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+
+        // value, time enabled, time running: scale up if the PMU was multiplexed
+        uint64_t buf[3];
+        if (read(pc->fds[i], buf, sizeof(buf)) != (ssize_t)sizeof(buf) || buf[2] == 0)
+            continue;
+        sample->values[i] = buf[2] < buf[1] ? (uint64_t)((double)buf[0] * buf[1] / buf[2]) : buf[0];
+        sample->valid[i] = true;
+    }
+}
+
+void perf_close(PerfCounters *pc)
+{
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+    {
+        if (pc->fds[i] >= 0)
+            close(pc->fds[i]);
+        pc->fds[i] = -1;
+    }
+}
+#else
+bool perf_open(PerfCounters *pc)
+{
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+        pc->fds[i] = -1;
+    return false;
+}
+
+void perf_start(PerfCounters *pc)
+{
+    (void)pc;
+}
+
+void perf_stop(PerfCounters *pc, PerfSample *sample)
+{
+    (void)pc;
+    memset(sample, 0, sizeof(*sample));
+}
+
+void perf_close(PerfCounters *pc)
+{
+    (void)pc;
+}
+#endif
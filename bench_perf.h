@@ -0,0 +1,36 @@
+#ifndef BENCH_PERF_H
+#define BENCH_PERF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// hardware counters sampled around each benchmark phase
+typedef enum
+{
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_CACHE_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_COUNTER_COUNT
+} PerfCounter;
+
+typedef struct
+{
+    int fds[PERF_COUNTER_COUNT]; // -1 when the counter could not be opened
+} PerfCounters;
+
+// counter values of one measurement, invalid entries could not be read
+typedef struct
+{
+    uint64_t values[PERF_COUNTER_COUNT];
+    bool valid[PERF_COUNTER_COUNT];
+} PerfSample;
+
+extern const char *perf_counter_names[PERF_COUNTER_COUNT];
+
+bool perf_open(PerfCounters *pc); // true if at least one counter is available
+void perf_start(PerfCounters *pc);
+void perf_stop(PerfCounters *pc, PerfSample *sample);
+void perf_close(PerfCounters *pc);
+
+#endif // BENCH_PERF_H
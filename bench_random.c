@@ -0,0 +1,65 @@
+#include "bench_random.h"
+#include <math.h>
+
+// splitmix64: small, fast and good enough for workload generation
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+void rng_seed(uint64_t seed)
+{
+    rng_state = seed;
+}
+
+uint64_t rng_next(void)
+{
+    uint64_t z = (rng_state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+int rng_below(int bound)
+{
+    return (int)(rng_next() % (uint64_t)bound);
+}
+
+double rng_unit(void)
+{
+    return (rng_next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+void shuffle(int *keys, int n)
+{
+    for (int i = n - 1; i > 0; i--)
+    {
+        int j = rng_below(i + 1);
+        int tmp = keys[i];
+        keys[i] = keys[j];
+        keys[j] = tmp;
+    }
+}
+
+// Gray et al., "Quickly Generating Billion-Record Synthetic Databases", the same
+// construction YCSB uses
+void zipf_init(Zipf *z, int n, double theta)
+{
+    double zeta2 = 1.0 + pow(0.5, theta);
+    z->n = n;
+    z->theta = theta;
+    z->zetan = 0.0;
+    for (int i = 1; i <= n; i++)
+        z->zetan += 1.0 / pow((double)i, theta);
+    z->alpha = 1.0 / (1.0 - theta);
+    z->eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / z->zetan);
+}
+
+int zipf_next(const Zipf *z)
+{
+    double u = rng_unit();
+    double uz = u * z->zetan;
+    if (uz < 1.0)
+        return 0;
+    if (uz < 1.0 + pow(0.5, z->theta))
+        return 1;
+    int v = (int)(z->n * pow(z->eta * u - z->eta + 1.0, z->alpha));
+    return v < z->n ? v : z->n - 1;
+}
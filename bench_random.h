@@ -0,0 +1,23 @@
+#ifndef BENCH_RANDOM_H
+#define BENCH_RANDOM_H
+
+#include <stdint.h>
+
+// process-wide generator used by the benchmark workloads
+void rng_seed(uint64_t seed);
+uint64_t rng_next(void);
+int rng_below(int bound);
+double rng_unit(void);
+void shuffle(int *keys, int n);
+
+// zipfian generator over [0, n)
+typedef struct
+{
+    int n;
+    double theta, alpha, zetan, eta;
+} Zipf;
+
+void zipf_init(Zipf *z, int n, double theta);
+int zipf_next(const Zipf *z);
+
+#endif // BENCH_RANDOM_H
@@ -0,0 +1,371 @@
+#define _GNU_SOURCE
+
+#include "AVL.h"
+#include "bench_random.h"
+#include "bench_scale.h"
+#include <errno.h>
+#include <stdint.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define MAX_SCALE_SIZES 16
+
+// bytes per entry above sizeof(AVLNode) * this factor are flagged as allocator overhead
+#define OVERHEAD_FLAG_RATIO 1.25
+
+// estimated bytes per entry when checking whether a size fits in physical memory
+#define ESTIMATED_ENTRY_BYTES 48
+
+typedef struct
+{
+    long long sizes[MAX_SCALE_SIZES];
+    int size_count;
+    long lookups;
+    uint64_t seed;
+    bool force;
+    const char *format;
+} ScaleConfig;
+
+// measurements of one size, filled in by the child process that built the tree
+typedef struct
+{
+    long long size;
+    int height;
+    double build_seconds;
+    double free_seconds;
+    long long rss_bytes;  // resident set growth while building
+    long long peak_bytes; // peak resident set of the child
+    double lookup_mean;
+    unsigned long long lookup_p50, lookup_p99, lookup_p999, lookup_max;
+    bool size_ok;         // root size matches the number of inserts
+    bool rss_ok;          // /proc/self/statm was readable
+    bool arena_ok;        // built with -DAVL_NODE_ARENA
+    double huge_page_ratio; // share of the node arena in huge pages after the build
+    char skipped[64];     // reason the size was not built, empty otherwise
+} ScaleResult;
+
+// keys live in the data pointers themselves, so the only memory per entry is the node;
+// multiplying by an odd constant permutes the indices into a random-looking order
+#define KEY_MULTIPLIER 0x9E3779B97F4A7C15ULL
+
+static void *scale_key(long long i)
+{
+    return (void *)(uintptr_t)((unsigned long long)(i + 1) * KEY_MULTIPLIER);
+}
+
+static int key_compare(const void *a, const void *b)
+{
+    uintptr_t ia = (uintptr_t)a, ib = (uintptr_t)b;
+    return (ia > ib) - (ia < ib);
+}
+
+static long long resident_bytes(void)
+{
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (!f)
+        return -1;
+    long long pages, resident;
+    int n = fscanf(f, "%lld %lld", &pages, &resident);
+    fclose(f);
+    return n == 2 ? resident * sysconf(_SC_PAGESIZE) : -1;
+}
+
+static long long physical_memory(void)
+{
+    long pages = sysconf(_SC_PHYS_PAGES), page = sysconf(_SC_PAGESIZE);
+    return pages > 0 && page > 0 ? (long long)pages * page : -1;
+}
+
+static double seconds_since(unsigned long long start)
+{
+    return (latencyClock() - start) / 1e9;
+}
+
+// build, probe and free one tree; runs in a child so every size starts from a fresh heap
+static void measure(const ScaleConfig *cfg, long long n, ScaleResult *r)
+{
+    long long rss_before = resident_bytes();
+
+    AVLNode *root = NULL;
+    unsigned long long start = latencyClock();
+    for (long long i = 0; i < n; i++)
+        root = insert(root, scale_key(i), key_compare);
+    r->build_seconds = seconds_since(start);
+
+    long long rss_after = resident_bytes();
+    r->rss_ok = rss_before >= 0 && rss_after >= 0;
+    r->rss_bytes = r->rss_ok ? rss_after - rss_before : 0;
+    r->height = getHeight(root);
+    r->size_ok = getSize(root) == n;
+    AVLArenaStats arena;
+    r->arena_ok = avlArenaStats(&arena);
+    r->huge_page_ratio = arena.hugePageRatio;
+
+    AVLHistogram hist;
+    histogramReset(&hist);
+    rng_seed(cfg->seed + (uint64_t)n);
+    long found = 0;
+    for (long i = 0; i < cfg->lookups; i++)
+    {
+        void *key = scale_key((long long)(rng_next() % (uint64_t)n));
+        unsigned long long t = latencyClock();
+        found += search(root, key, key_compare) != NULL;
+        histogramRecord(&hist, latencyClock() - t);
+    }
+    if (found != cfg->lookups)
+        r->size_ok = false;
+    r->lookup_mean = hist.total ? (double)hist.sum / hist.total : 0.0;
+    r->lookup_p50 = histogramPercentile(&hist, 50.0);
+    r->lookup_p99 = histogramPercentile(&hist, 99.0);
+    r->lookup_p999 = histogramPercentile(&hist, 99.9);
+    r->lookup_max = hist.total ? hist.max : 0;
+
+    start = latencyClock();
+    freeAVLTree(root, NULL);
+    r->free_seconds = seconds_since(start);
+
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+        r->peak_bytes = (long long)usage.ru_maxrss * 1024;
+}
+
+static bool run_size(const ScaleConfig *cfg, long long n, ScaleResult *r)
+{
+    memset(r, 0, sizeof(*r));
+    r->size = n;
+
+    // AVLNode counts subtree sizes in avl_size_t (int unless built with AVL_LARGE_TREE)
+    if (n > AVL_SIZE_MAX)
+    {
+        snprintf(r->skipped, sizeof(r->skipped), "size field limit (%lld nodes)", (long long)AVL_SIZE_MAX);
+        return true;
+    }
+    long long needed = n * ESTIMATED_ENTRY_BYTES, available = physical_memory();
+    if (!cfg->force && available > 0 && needed > available)
+    {
+        snprintf(r->skipped, sizeof(r->skipped), "needs ~%.1f GB of %.1f GB RAM", needed / 1e9, available / 1e9);
+        return true;
+    }
+
+    int fds[2];
+    if (pipe(fds) != 0)
+    {
+        perror("pipe");
+        return false;
+    }
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("fork");
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid == 0)
+    {
+        close(fds[0]);
+        measure(cfg, n, r);
+        ssize_t written = write(fds[1], r, sizeof(*r));
+        _exit(written == (ssize_t)sizeof(*r) ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    close(fds[1]);
+    ssize_t got;
+    do
+        got = read(fds[0], r, sizeof(*r));
+    while (got < 0 && errno == EINTR);
+    close(fds[0]);
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+        ;
+    if (got != (ssize_t)sizeof(*r))
+    {
+        memset(r, 0, sizeof(*r));
+        r->size = n;
+        if (WIFSIGNALED(status))
+            snprintf(r->skipped, sizeof(r->skipped), "killed by signal %d (out of memory?)", WTERMSIG(status));
+        else
+            snprintf(r->skipped, sizeof(r->skipped), "measurement failed");
+    }
+    return true;
+}
+
+// comma-separated bottlenecks worth acting on at this size
+static void result_flags(const ScaleResult *r, char *buf, size_t len)
+{
+    buf[0] = '\0';
+    if (r->skipped[0])
+    {
+        snprintf(buf, len, "skipped: %s", r->skipped);
+        return;
+    }
+
+    double per_entry = r->rss_ok ? (double)r->rss_bytes / r->size : 0.0;
+    size_t used = 0;
+    if (!r->size_ok)
+        used += snprintf(buf + used, len - used, "%swrong size", used ? "," : "");
+    if (r->size > AVL_SIZE_MAX / 2)
+        used += snprintf(buf + used, len - used, "%snear size field limit", used ? "," : "");
+    if (per_entry > sizeof(AVLNode) * OVERHEAD_FLAG_RATIO)
+        used += snprintf(buf + used, len - used, "%sallocator overhead %.0f%%", used ? "," : "",
+                         100.0 * (per_entry - sizeof(AVLNode)) / sizeof(AVLNode));
+    if (r->arena_ok)
+        used += snprintf(buf + used, len - used, "%shuge pages %.0f%%", used ? "," : "", 100.0 * r->huge_page_ratio);
+    if (!r->rss_ok)
+        snprintf(buf + used, len - used, "%sno RSS", used ? "," : "");
+}
+
+static void print_results(const ScaleConfig *cfg, const ScaleResult *results, int count)
+{
+    bool json = strcmp(cfg->format, "json") == 0, csv = strcmp(cfg->format, "csv") == 0;
+    if (csv)
+        printf("size,height,build_s,ns_per_insert,free_s,rss_bytes,peak_bytes,bytes_per_entry,"
+               "lookup_mean_ns,lookup_p50,lookup_p99,lookup_p999,lookup_max,flags\n");
+    else if (json)
+        printf("[");
+    else
+        printf("%12s %6s %9s %9s %10s %10s %9s %9s %7s %7s %7s  %s\n", "size", "height", "build s", "ns/insert",
+               "rss MB", "peak MB", "B/entry", "lookup", "p50", "p99", "p99.9", "flags");
+
+    for (int i = 0; i < count; i++)
+    {
+        const ScaleResult *r = &results[i];
+        char flags[160];
+        result_flags(r, flags, sizeof(flags));
+        double ns_per_insert = r->size ? r->build_seconds * 1e9 / r->size : 0.0;
+        double per_entry = r->rss_ok && r->size ? (double)r->rss_bytes / r->size : 0.0;
+
+        if (csv)
+            printf("%lld,%d,%.3f,%.1f,%.3f,%lld,%lld,%.2f,%.1f,%llu,%llu,%llu,%llu,\"%s\"\n", r->size, r->height,
+                   r->build_seconds, ns_per_insert, r->free_seconds, r->rss_bytes, r->peak_bytes, per_entry,
+                   r->lookup_mean, r->lookup_p50, r->lookup_p99, r->lookup_p999, r->lookup_max, flags);
+        else if (json)
+            printf("%s\n  {\"size\": %lld, \"height\": %d, \"build_s\": %.3f, \"ns_per_insert\": %.1f, "
+                   "\"free_s\": %.3f, \"rss_bytes\": %lld, \"peak_bytes\": %lld, \"bytes_per_entry\": %.2f, "
+                   "\"lookup_mean_ns\": %.1f, \"lookup_p50\": %llu, \"lookup_p99\": %llu, \"lookup_p999\": %llu, "
+                   "\"lookup_max\": %llu, \"flags\": \"%s\"}",
+                   i ? "," : "", r->size, r->height, r->build_seconds, ns_per_insert, r->free_seconds, r->rss_bytes,
+                   r->peak_bytes, per_entry, r->lookup_mean, r->lookup_p50, r->lookup_p99, r->lookup_p999,
+                   r->lookup_max, flags);
+        else if (r->skipped[0])
+            printf("%12lld %6s %9s %9s %10s %10s %9s %9s %7s %7s %7s  %s\n", r->size, "-", "-", "-", "-", "-", "-",
+                   "-", "-", "-", "-", flags);
+        else
+            printf("%12lld %6d %9.2f %9.1f %10.1f %10.1f %9.1f %9.1f %7llu %7llu %7llu  %s\n", r->size, r->height,
+                   r->build_seconds, ns_per_insert, r->rss_bytes / 1048576.0, r->peak_bytes / 1048576.0, per_entry,
+                   r->lookup_mean, r->lookup_p50, r->lookup_p99, r->lookup_p999, flags);
+    }
+    if (json)
+        printf("\n]\n");
+    else if (!csv)
+        printf("\nsizeof(AVLNode) = %zu bytes; lookup columns are ns per search\n", sizeof(AVLNode));
+}
+
+static void scale_usage(void)
+{
+    fprintf(stderr,
+            "Usage: benchmark scale [options]\n"
+            "  --sizes=N[,N...]      tree sizes, K/M/G suffixes allowed (default 10M,100M,500M)\n"
+            "  --lookups=N           timed random searches per size (default 1000000)\n"
+            "  --seed=N              random seed\n"
+            "  --force               build sizes that look too large for physical memory\n"
+            "  --format=FMT          text, csv or json (default text)\n");
+}
+
+static bool parse_count(const char *tok, long long *out)
+{
+    char *end;
+    long long v = strtoll(tok, &end, 10);
+    long long unit = 1;
+    if (*end == 'K' || *end == 'k')
+        unit = 1000LL, end++;
+    else if (*end == 'M' || *end == 'm')
+        unit = 1000000LL, end++;
+    else if (*end == 'G' || *end == 'g')
+        unit = 1000000000LL, end++;
+    if (*end || v <= 0 || v > LLONG_MAX / unit)
+        return false;
+    *out = v * unit;
+    return true;
+}
+
+static bool parse_scale_sizes(ScaleConfig *cfg, const char *list)
+{
+    cfg->size_count = 0;
+    char *copy = malloc(strlen(list) + 1);
+    if (!copy)
+        return false;
+    strcpy(copy, list);
+
+    bool ok = true;
+    for (char *tok = strtok(copy, ","); tok && ok; tok = strtok(NULL, ","))
+        ok = cfg->size_count < MAX_SCALE_SIZES && parse_count(tok, &cfg->sizes[cfg->size_count++]);
+    free(copy);
+    return ok && cfg->size_count > 0;
+}
+
+static bool parse_scale_args(ScaleConfig *cfg, int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const char *val = strchr(arg, '=');
+        val = val ? val + 1 : "";
+
+        if (strncmp(arg, "--sizes=", 8) == 0)
+        {
+            if (!parse_scale_sizes(cfg, val))
+                return false;
+        }
+        else if (strncmp(arg, "--lookups=", 10) == 0)
+        {
+            long long lookups;
+            if (!parse_count(val, &lookups) || lookups > LONG_MAX)
+                return false;
+            cfg->lookups = (long)lookups;
+        }
+        else if (strncmp(arg, "--seed=", 7) == 0)
+            cfg->seed = strtoull(val, NULL, 10);
+        else if (strcmp(arg, "--force") == 0)
+            cfg->force = true;
+        else if (strncmp(arg, "--format=", 9) == 0)
+        {
+            if (strcmp(val, "text") != 0 && strcmp(val, "csv") != 0 && strcmp(val, "json") != 0)
+                return false;
+            cfg->format = val;
+        }
+        else
+            return false;
+    }
+    return true;
+}
+
+int scale_main(int argc, char **argv)
+{
+    ScaleConfig cfg = {
+        .sizes = {10000000LL, 100000000LL, 500000000LL},
+        .size_count = 3,
+        .lookups = 1000000,
+        .seed = 42,
+        .format = "text",
+    };
+    if (!parse_scale_args(&cfg, argc, argv))
+    {
+        scale_usage();
+        return EXIT_FAILURE;
+    }
+
+    ScaleResult results[MAX_SCALE_SIZES];
+    for (int i = 0; i < cfg.size_count; i++)
+    {
+        fprintf(stderr, "building %lld nodes...\n", cfg.sizes[i]);
+        if (!run_size(&cfg, cfg.sizes[i], &results[i]))
+            return EXIT_FAILURE;
+    }
+
+    print_results(&cfg, results, cfg.size_count);
+    return EXIT_SUCCESS;
+}
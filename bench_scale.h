@@ -0,0 +1,8 @@
+#ifndef BENCH_SCALE_H
+#define BENCH_SCALE_H
+
+// `benchmark scale ...`: build one tree per size and report memory, build time
+// and lookup latency, flagging the limits that stop the tree from growing further
+int scale_main(int argc, char **argv);
+
+#endif // BENCH_SCALE_H
@@ -0,0 +1,1003 @@
+#include "bench_structs.h"
+#include <stdint.h>
+
+static void *xcalloc(size_t count, size_t size)
+{
+    void *ptr = calloc(count, size);
+    if (!ptr)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+// === AVL Tree ===
+// avl2 and avl3 are relaxed AVL(k) trees sharing the same code with a looser balance;
+// avl-lazy writes at the loosest balance and restores strict AVL before each read
+// (rebalanceAll); wavl is the same node type updated with the weak AVL insert and delete;
+// avl-tomb (with -DAVL_TOMBSTONES) deletes by tombstone and compacts in batches
+typedef struct
+{
+    AVLNode *root;
+    compare_func_t compare;
+    int maxBalance;
+    bool deferred;
+} AVLSet;
+
+static void *avl_create_balance(compare_func_t compare, int maxBalance)
+{
+    AVLSet *s = xcalloc(1, sizeof(AVLSet));
+    s->compare = compare;
+    s->maxBalance = maxBalance;
+    return s;
+}
+
+static void *avl_create(compare_func_t compare) { return avl_create_balance(compare, AVL_MAX_BALANCE); }
+static void *avl2_create(compare_func_t compare) { return avl_create_balance(compare, 2); }
+static void *avl3_create(compare_func_t compare) { return avl_create_balance(compare, 3); }
+
+static void *avl_lazy_create(compare_func_t compare)
+{
+    AVLSet *s = avl_create_balance(compare, AVL_RELAXED_BALANCE_MAX);
+    s->deferred = true;
+    return s;
+}
+
+// root for a read: a deferred tree settles its pending rebalancing first
+static AVLNode *avl_root(AVLSet *s)
+{
+    if (s->deferred)
+        s->root = rebalanceAll(s->root);
+    return s->root;
+}
+
+static void avl_destroy(void *set)
+{
+    AVLSet *s = set;
+    freeAVLTree(s->root, NULL);
+    free(s);
+}
+
+static void avl_insert(void *set, void *data)
+{
+    AVLSet *s = set;
+    s->root = insertRelaxed(s->root, data, s->compare, s->maxBalance);
+}
+
+static void avl_remove(void *set, void *data)
+{
+    AVLSet *s = set;
+    s->root = deleteRelaxed(s->root, data, s->compare, NULL, s->maxBalance);
+}
+
+static void wavl_insert(void *set, void *data)
+{
+    AVLSet *s = set;
+    s->root = wavlInsert(s->root, data, s->compare);
+}
+
+static void wavl_remove(void *set, void *data)
+{
+    AVLSet *s = set;
+    s->root = wavlDelete(s->root, data, s->compare, NULL);
+}
+
+#ifdef AVL_TOMBSTONES
+static void tomb_insert(void *set, void *data)
+{
+    AVLSet *s = set;
+    s->root = insertRevive(s->root, data, s->compare, NULL);
+}
+
+static void tomb_remove(void *set, void *data)
+{
+    AVLSet *s = set;
+    s->root = tombstoneDelete(s->root, data, s->compare, NULL);
+}
+#endif
+
+static void *avl_search(void *set, void *data)
+{
+    AVLSet *s = set;
+    AVLNode *node = search(avl_root(s), data, s->compare);
+    return node ? node->data : NULL;
+}
+
+static void avl_range(void *set, void *minVal, void *maxVal, range_callback_t callback, void *context)
+{
+    AVLSet *s = set;
+    rangeQuery(avl_root(s), minVal, maxVal, s->compare, callback, context);
+}
+
+static long avl_count_range(void *set, void *minVal, void *maxVal)
+{
+    AVLSet *s = set;
+    return countRange(avl_root(s), minVal, maxVal, s->compare);
+}
+
+static long avl_rank(void *set, void *data)
+{
+    AVLSet *s = set;
+    return getRank(avl_root(s), data, s->compare);
+}
+
+static void *avl_kth(void *set, long k)
+{
+    AVLSet *s = set;
+    AVLNode *node = findKthSmallest(avl_root(s), (avl_size_t)k);
+    return node ? node->data : NULL;
+}
+
+// === Red-Black Tree ===
+// classic bottom-up red-black tree (CLRS) with parent pointers and a sentinel leaf
+typedef struct RBNode
+{
+    void *data;
+    struct RBNode *left, *right, *parent;
+    bool red;
+} RBNode;
+
+typedef struct
+{
+    RBNode *root;
+    RBNode nil;
+    compare_func_t compare;
+} RBTree;
+
+static void *rb_create(compare_func_t compare)
+{
+    RBTree *t = xcalloc(1, sizeof(RBTree));
+    t->nil.left = t->nil.right = t->nil.parent = &t->nil;
+    t->nil.red = false;
+    t->root = &t->nil;
+    t->compare = compare;
+    return t;
+}
+
+static void rb_free_nodes(RBTree *t, RBNode *node)
+{
+    while (node != &t->nil)
+    {
+        rb_free_nodes(t, node->left);
+        RBNode *right = node->right;
+        free(node);
+        node = right;
+    }
+}
+
+static void rb_destroy(void *set)
+{
+    RBTree *t = set;
+    rb_free_nodes(t, t->root);
+    free(t);
+}
+
+static void rb_rotate_left(RBTree *t, RBNode *x)
+{
+    RBNode *y = x->right;
+    x->right = y->left;
+    if (y->left != &t->nil)
+        y->left->parent = x;
+    y->parent = x->parent;
+    if (x->parent == &t->nil)
+        t->root = y;
+    else if (x == x->parent->left)
+        x->parent->left = y;
+    else
+        x->parent->right = y;
+    y->left = x;
+    x->parent = y;
+}
+
+static void rb_rotate_right(RBTree *t, RBNode *x)
+{
+    RBNode *y = x->left;
+    x->left = y->right;
+    if (y->right != &t->nil)
+        y->right->parent = x;
+    y->parent = x->parent;
+    if (x->parent == &t->nil)
+        t->root = y;
+    else if (x == x->parent->right)
+        x->parent->right = y;
+    else
+        x->parent->left = y;
+    y->right = x;
+    x->parent = y;
+}
+
+static void rb_insert(void *set, void *data)
+{
+    RBTree *t = set;
+    RBNode *parent = &t->nil, *cur = t->root;
+    int cmp = 0;
+    while (cur != &t->nil)
+    {
+        cmp = t->compare(data, cur->data);
+        if (cmp == 0)
+            return; // no duplicates
+        parent = cur;
+        cur = cmp < 0 ? cur->left : cur->right;
+    }
+
+    RBNode *z = xcalloc(1, sizeof(RBNode));
+    z->data = data;
+    z->left = z->right = &t->nil;
+    z->parent = parent;
+    z->red = true;
+    if (parent == &t->nil)
+        t->root = z;
+    else if (cmp < 0)
+        parent->left = z;
+    else
+        parent->right = z;
+
+    while (z->parent->red)
+    {
+        RBNode *g = z->parent->parent;
+        if (z->parent == g->left)
+        {
+            RBNode *uncle = g->right;
+            if (uncle->red)
+            {
+                z->parent->red = uncle->red = false;
+                g->red = true;
+                z = g;
+            }
+            else
+            {
+                if (z == z->parent->right)
+                {
+                    z = z->parent;
+                    rb_rotate_left(t, z);
+                }
+                z->parent->red = false;
+                g->red = true;
+                rb_rotate_right(t, g);
+            }
+        }
+        else
+        {
+            RBNode *uncle = g->left;
+            if (uncle->red)
+            {
+                z->parent->red = uncle->red = false;
+                g->red = true;
+                z = g;
+            }
+            else
+            {
+                if (z == z->parent->left)
+                {
+                    z = z->parent;
+                    rb_rotate_right(t, z);
+                }
+                z->parent->red = false;
+                g->red = true;
+                rb_rotate_left(t, g);
+            }
+        }
+    }
+    t->root->red = false;
+}
+
+static RBNode *rb_find(RBTree *t, void *data)
+{
+    RBNode *cur = t->root;
+    while (cur != &t->nil)
+    {
+        int cmp = t->compare(data, cur->data);
+        if (cmp == 0)
+            return cur;
+        cur = cmp < 0 ? cur->left : cur->right;
+    }
+    return NULL;
+}
+
+static void rb_transplant(RBTree *t, RBNode *u, RBNode *v)
+{
+    if (u->parent == &t->nil)
+        t->root = v;
+    else if (u == u->parent->left)
+        u->parent->left = v;
+    else
+        u->parent->right = v;
+    v->parent = u->parent;
+}
+
+static void rb_remove(void *set, void *data)
+{
+    RBTree *t = set;
+    RBNode *z = rb_find(t, data);
+    if (!z)
+        return;
+
+    RBNode *y = z, *x;
+    bool removedRed = y->red;
+    if (z->left == &t->nil)
+    {
+        x = z->right;
+        rb_transplant(t, z, z->right);
+    }
+    else if (z->right == &t->nil)
+    {
+        x = z->left;
+        rb_transplant(t, z, z->left);
+    }
+    else
+    {
+        y = z->right;
+        while (y->left != &t->nil)
+            y = y->left;
+        removedRed = y->red;
+        x = y->right;
+        if (y->parent == z)
+            x->parent = y;
+        else
+        {
+            rb_transplant(t, y, y->right);
+            y->right = z->right;
+            y->right->parent = y;
+        }
+        rb_transplant(t, z, y);
+        y->left = z->left;
+        y->left->parent = y;
+        y->red = z->red;
+    }
+    free(z);
+
+    if (removedRed)
+        return;
+
+    while (x != t->root && !x->red)
+    {
+        if (x == x->parent->left)
+        {
+            RBNode *w = x->parent->right;
+            if (w->red)
+            {
+                w->red = false;
+                x->parent->red = true;
+                rb_rotate_left(t, x->parent);
+                w = x->parent->right;
+            }
+            if (!w->left->red && !w->right->red)
+            {
+                w->red = true;
+                x = x->parent;
+            }
+            else
+            {
+                if (!w->right->red)
+                {
+                    w->left->red = false;
+                    w->red = true;
+                    rb_rotate_right(t, w);
+                    w = x->parent->right;
+                }
+                w->red = x->parent->red;
+                x->parent->red = false;
+                w->right->red = false;
+                rb_rotate_left(t, x->parent);
+                x = t->root;
+            }
+        }
+        else
+        {
+            RBNode *w = x->parent->left;
+            if (w->red)
+            {
+                w->red = false;
+                x->parent->red = true;
+                rb_rotate_right(t, x->parent);
+                w = x->parent->left;
+            }
+            if (!w->right->red && !w->left->red)
+            {
+                w->red = true;
+                x = x->parent;
+            }
+            else
+            {
+                if (!w->left->red)
+                {
+                    w->right->red = false;
+                    w->red = true;
+                    rb_rotate_left(t, w);
+                    w = x->parent->left;
+                }
+                w->red = x->parent->red;
+                x->parent->red = false;
+                w->left->red = false;
+                rb_rotate_right(t, x->parent);
+                x = t->root;
+            }
+        }
+    }
+    x->red = false;
+}
+
+static void *rb_search(void *set, void *data)
+{
+    RBNode *node = rb_find(set, data);
+    return node ? node->data : NULL;
+}
+
+static void rb_range_rec(RBTree *t, RBNode *node, void *minVal, void *maxVal,
+                         range_callback_t callback, void *context)
+{
+    while (node != &t->nil)
+    {
+        int cmpMin = t->compare(node->data, minVal);
+        int cmpMax = t->compare(node->data, maxVal);
+        if (cmpMin > 0)
+            rb_range_rec(t, node->left, minVal, maxVal, callback, context);
+        if (cmpMin >= 0 && cmpMax <= 0)
+            callback(node->data, context);
+        if (cmpMax >= 0)
+            return;
+        node = node->right;
+    }
+}
+
+static void rb_range(void *set, void *minVal, void *maxVal, range_callback_t callback, void *context)
+{
+    RBTree *t = set;
+    rb_range_rec(t, t->root, minVal, maxVal, callback, context);
+}
+
+// === Skip List ===
+// Pugh's skip list with p = 1/4
+#define SKIP_MAX_LEVEL 32
+
+typedef struct SkipNode
+{
+    void *data;
+    int level;
+    struct SkipNode *next[]; // one forward pointer per level
+} SkipNode;
+
+typedef struct
+{
+    SkipNode *head;
+    int level;
+    uint64_t rng;
+    compare_func_t compare;
+} SkipList;
+
+static SkipNode *skip_node(void *data, int level)
+{
+    SkipNode *node = xcalloc(1, sizeof(SkipNode) + level * sizeof(SkipNode *));
+    node->data = data;
+    node->level = level;
+    return node;
+}
+
+static void *skip_create(compare_func_t compare)
+{
+    SkipList *l = xcalloc(1, sizeof(SkipList));
+    l->head = skip_node(NULL, SKIP_MAX_LEVEL);
+    l->level = 1;
+    l->rng = 0x2545F4914F6CDD1DULL;
+    l->compare = compare;
+    return l;
+}
+
+static void skip_destroy(void *set)
+{
+    SkipList *l = set;
+    SkipNode *node = l->head;
+    while (node)
+    {
+        SkipNode *next = node->next[0];
+        free(node);
+        node = next;
+    }
+    free(l);
+}
+
+static int skip_random_level(SkipList *l)
+{
+    // xorshift64, two bits per level
+    l->rng ^= l->rng << 13;
+    l->rng ^= l->rng >> 7;
+    l->rng ^= l->rng << 17;
+    uint64_t bits = l->rng;
+    int level = 1;
+    while (level < SKIP_MAX_LEVEL && (bits & 3) == 0)
+    {
+        level++;
+        bits >>= 2;
+    }
+    return level;
+}
+
+// fill update[] with the last node before data on every level
+static SkipNode *skip_find(SkipList *l, void *data, SkipNode **update)
+{
+    SkipNode *node = l->head;
+    for (int i = l->level - 1; i >= 0; i--)
+    {
+        while (node->next[i] && l->compare(node->next[i]->data, data) < 0)
+            node = node->next[i];
+        if (update)
+            update[i] = node;
+    }
+    return node->next[0];
+}
+
+static void skip_insert(void *set, void *data)
+{
+    SkipList *l = set;
+    SkipNode *update[SKIP_MAX_LEVEL];
+    SkipNode *found = skip_find(l, data, update);
+    if (found && l->compare(found->data, data) == 0)
+        return;
+
+    int level = skip_random_level(l);
+    for (int i = l->level; i < level; i++)
+        update[i] = l->head;
+    if (level > l->level)
+        l->level = level;
+
+    SkipNode *node = skip_node(data, level);
+    for (int i = 0; i < level; i++)
+    {
+        node->next[i] = update[i]->next[i];
+        update[i]->next[i] = node;
+    }
+}
+
+static void skip_remove(void *set, void *data)
+{
+    SkipList *l = set;
+    SkipNode *update[SKIP_MAX_LEVEL];
+    SkipNode *found = skip_find(l, data, update);
+    if (!found || l->compare(found->data, data) != 0)
+        return;
+
+    for (int i = 0; i < found->level; i++)
+        update[i]->next[i] = found->next[i];
+    while (l->level > 1 && !l->head->next[l->level - 1])
+        l->level--;
+    free(found);
+}
+
+static void *skip_search(void *set, void *data)
+{
+    SkipList *l = set;
+    SkipNode *found = skip_find(l, data, NULL);
+    return found && l->compare(found->data, data) == 0 ? found->data : NULL;
+}
+
+static void skip_range(void *set, void *minVal, void *maxVal, range_callback_t callback, void *context)
+{
+    SkipList *l = set;
+    for (SkipNode *node = skip_find(l, minVal, NULL); node && l->compare(node->data, maxVal) <= 0;
+         node = node->next[0])
+        callback(node->data, context);
+}
+
+// === B+ Tree ===
+// keys live in linked leaves, inner nodes only route; nodes hold up to BPT_ORDER keys
+// (plus one transient slot while splitting) and merge or borrow below BPT_MIN
+#define BPT_ORDER 32
+#define BPT_MIN (BPT_ORDER / 2)
+
+typedef struct BPNode
+{
+    bool leaf;
+    int count;                            // number of keys
+    void *keys[BPT_ORDER + 1];
+    struct BPNode *children[BPT_ORDER + 2]; // inner nodes only
+    struct BPNode *next;                  // leaves only
+} BPNode;
+
+typedef struct
+{
+    BPNode *root;
+    compare_func_t compare;
+} BPTree;
+
+static BPNode *bpt_node(bool leaf)
+{
+    BPNode *node = xcalloc(1, sizeof(BPNode));
+    node->leaf = leaf;
+    return node;
+}
+
+static void *bpt_create(compare_func_t compare)
+{
+    BPTree *t = xcalloc(1, sizeof(BPTree));
+    t->root = bpt_node(true);
+    t->compare = compare;
+    return t;
+}
+
+static void bpt_free_nodes(BPNode *node)
+{
+    if (!node->leaf)
+        for (int i = 0; i <= node->count; i++)
+            bpt_free_nodes(node->children[i]);
+    free(node);
+}
+
+static void bpt_destroy(void *set)
+{
+    BPTree *t = set;
+    bpt_free_nodes(t->root);
+    free(t);
+}
+
+// first key position >= data
+static int bpt_lower_bound(const BPTree *t, const BPNode *node, void *data)
+{
+    int lo = 0, hi = node->count;
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (t->compare(node->keys[mid], data) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// child to follow: number of separators <= data
+static int bpt_child_index(const BPTree *t, const BPNode *node, void *data)
+{
+    int lo = 0, hi = node->count;
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (t->compare(node->keys[mid], data) <= 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// returns the new right sibling if node split, with its separator in *sep
+static BPNode *bpt_insert_rec(BPTree *t, BPNode *node, void *data, void **sep)
+{
+    if (node->leaf)
+    {
+        int pos = bpt_lower_bound(t, node, data);
+        if (pos < node->count && t->compare(node->keys[pos], data) == 0)
+            return NULL; // no duplicates
+        memmove(&node->keys[pos + 1], &node->keys[pos], (node->count - pos) * sizeof(void *));
+        node->keys[pos] = data;
+        if (++node->count <= BPT_ORDER)
+            return NULL;
+
+        BPNode *right = bpt_node(true);
+        int half = node->count / 2;
+        right->count = node->count - half;
+        memcpy(right->keys, &node->keys[half], right->count * sizeof(void *));
+        node->count = half;
+        right->next = node->next;
+        node->next = right;
+        *sep = right->keys[0];
+        return right;
+    }
+
+    int idx = bpt_child_index(t, node, data);
+    void *childSep;
+    BPNode *split = bpt_insert_rec(t, node->children[idx], data, &childSep);
+    if (!split)
+        return NULL;
+
+    memmove(&node->keys[idx + 1], &node->keys[idx], (node->count - idx) * sizeof(void *));
+    memmove(&node->children[idx + 2], &node->children[idx + 1], (node->count - idx) * sizeof(BPNode *));
+    node->keys[idx] = childSep;
+    node->children[idx + 1] = split;
+    if (++node->count <= BPT_ORDER)
+        return NULL;
+
+    // the middle key moves up, the right half moves to a new node
+    BPNode *right = bpt_node(false);
+    int mid = node->count / 2;
+    *sep = node->keys[mid];
+    right->count = node->count - mid - 1;
+    memcpy(right->keys, &node->keys[mid + 1], right->count * sizeof(void *));
+    memcpy(right->children, &node->children[mid + 1], (right->count + 1) * sizeof(BPNode *));
+    node->count = mid;
+    return right;
+}
+
+static void bpt_insert(void *set, void *data)
+{
+    BPTree *t = set;
+    void *sep;
+    BPNode *split = bpt_insert_rec(t, t->root, data, &sep);
+    if (!split)
+        return;
+
+    BPNode *root = bpt_node(false);
+    root->count = 1;
+    root->keys[0] = sep;
+    root->children[0] = t->root;
+    root->children[1] = split;
+    t->root = root;
+}
+
+// restore the minimum fill of parent->children[i] by borrowing or merging
+static void bpt_fix_child(BPNode *parent, int i)
+{
+    BPNode *child = parent->children[i];
+    BPNode *left = i > 0 ? parent->children[i - 1] : NULL;
+    BPNode *right = i < parent->count ? parent->children[i + 1] : NULL;
+
+    if (left && left->count > BPT_MIN)
+    {
+        memmove(&child->keys[1], &child->keys[0], child->count * sizeof(void *));
+        if (child->leaf)
+        {
+            child->keys[0] = left->keys[left->count - 1];
+            parent->keys[i - 1] = child->keys[0];
+        }
+        else
+        {
+            memmove(&child->children[1], &child->children[0], (child->count + 1) * sizeof(BPNode *));
+            child->keys[0] = parent->keys[i - 1];
+            child->children[0] = left->children[left->count];
+            parent->keys[i - 1] = left->keys[left->count - 1];
+        }
+        child->count++;
+        left->count--;
+        return;
+    }
+
+    if (right && right->count > BPT_MIN)
+    {
+        if (child->leaf)
+        {
+            child->keys[child->count] = right->keys[0];
+            memmove(&right->keys[0], &right->keys[1], (right->count - 1) * sizeof(void *));
+            parent->keys[i] = right->keys[0];
+        }
+        else
+        {
+            child->keys[child->count] = parent->keys[i];
+            child->children[child->count + 1] = right->children[0];
+            parent->keys[i] = right->keys[0];
+            memmove(&right->keys[0], &right->keys[1], (right->count - 1) * sizeof(void *));
+            memmove(&right->children[0], &right->children[1], right->count * sizeof(BPNode *));
+        }
+        child->count++;
+        right->count--;
+        return;
+    }
+
+    // merge with a sibling: the right node of the pair is folded into the left one
+    int sepIdx = left ? i - 1 : i;
+    BPNode *l = parent->children[sepIdx], *r = parent->children[sepIdx + 1];
+    if (l->leaf)
+    {
+        memcpy(&l->keys[l->count], r->keys, r->count * sizeof(void *));
+        l->count += r->count;
+        l->next = r->next;
+    }
+    else
+    {
+        l->keys[l->count] = parent->keys[sepIdx];
+        memcpy(&l->keys[l->count + 1], r->keys, r->count * sizeof(void *));
+        memcpy(&l->children[l->count + 1], r->children, (r->count + 1) * sizeof(BPNode *));
+        l->count += r->count + 1;
+    }
+    free(r);
+
+    memmove(&parent->keys[sepIdx], &parent->keys[sepIdx + 1], (parent->count - sepIdx - 1) * sizeof(void *));
+    memmove(&parent->children[sepIdx + 1], &parent->children[sepIdx + 2],
+            (parent->count - sepIdx - 1) * sizeof(BPNode *));
+    parent->count--;
+}
+
+static void bpt_remove_rec(BPTree *t, BPNode *node, void *data)
+{
+    if (node->leaf)
+    {
+        int pos = bpt_lower_bound(t, node, data);
+        if (pos < node->count && t->compare(node->keys[pos], data) == 0)
+        {
+            memmove(&node->keys[pos], &node->keys[pos + 1], (node->count - pos - 1) * sizeof(void *));
+            node->count--;
+        }
+        return;
+    }
+
+    int idx = bpt_child_index(t, node, data);
+    bpt_remove_rec(t, node->children[idx], data);
+    if (node->children[idx]->count < BPT_MIN)
+        bpt_fix_child(node, idx);
+}
+
+static void bpt_remove(void *set, void *data)
+{
+    BPTree *t = set;
+    bpt_remove_rec(t, t->root, data);
+    if (!t->root->leaf && t->root->count == 0)
+    {
+        BPNode *old = t->root;
+        t->root = old->children[0];
+        free(old);
+    }
+}
+
+static BPNode *bpt_find_leaf(BPTree *t, void *data)
+{
+    BPNode *node = t->root;
+    while (!node->leaf)
+        node = node->children[bpt_child_index(t, node, data)];
+    return node;
+}
+
+static void *bpt_search(void *set, void *data)
+{
+    BPTree *t = set;
+    BPNode *leaf = bpt_find_leaf(t, data);
+    int pos = bpt_lower_bound(t, leaf, data);
+    return pos < leaf->count && t->compare(leaf->keys[pos], data) == 0 ? leaf->keys[pos] : NULL;
+}
+
+static void bpt_range(void *set, void *minVal, void *maxVal, range_callback_t callback, void *context)
+{
+    BPTree *t = set;
+    BPNode *leaf = bpt_find_leaf(t, minVal);
+    int pos = bpt_lower_bound(t, leaf, minVal);
+    for (; leaf; leaf = leaf->next, pos = 0)
+    {
+        for (; pos < leaf->count; pos++)
+        {
+            if (t->compare(leaf->keys[pos], maxVal) > 0)
+                return;
+            callback(leaf->keys[pos], context);
+        }
+    }
+}
+
+// === Sorted Array ===
+// binary search over a contiguous array; inserts and deletes shift the tail
+typedef struct
+{
+    void **items;
+    long count, capacity;
+    compare_func_t compare;
+} SortedArray;
+
+static void *sorted_create(compare_func_t compare)
+{
+    SortedArray *a = xcalloc(1, sizeof(SortedArray));
+    a->compare = compare;
+    return a;
+}
+
+static void sorted_destroy(void *set)
+{
+    SortedArray *a = set;
+    free(a->items);
+    free(a);
+}
+
+// first position whose item is >= data (upper: > data)
+static long sorted_bound(const SortedArray *a, void *data, bool upper)
+{
+    long lo = 0, hi = a->count;
+    while (lo < hi)
+    {
+        long mid = lo + (hi - lo) / 2;
+        int cmp = a->compare(a->items[mid], data);
+        if (cmp < 0 || (upper && cmp == 0))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static void sorted_insert(void *set, void *data)
+{
+    SortedArray *a = set;
+    long pos = sorted_bound(a, data, false);
+    if (pos < a->count && a->compare(a->items[pos], data) == 0)
+        return;
+    if (a->count == a->capacity)
+    {
+        a->capacity = a->capacity ? 2 * a->capacity : 64;
+        a->items = realloc(a->items, a->capacity * sizeof(void *));
+        if (!a->items)
+        {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    memmove(&a->items[pos + 1], &a->items[pos], (a->count - pos) * sizeof(void *));
+    a->items[pos] = data;
+    a->count++;
+}
+
+static void sorted_remove(void *set, void *data)
+{
+    SortedArray *a = set;
+    long pos = sorted_bound(a, data, false);
+    if (pos == a->count || a->compare(a->items[pos], data) != 0)
+        return;
+    memmove(&a->items[pos], &a->items[pos + 1], (a->count - pos - 1) * sizeof(void *));
+    a->count--;
+}
+
+static void *sorted_search(void *set, void *data)
+{
+    SortedArray *a = set;
+    long pos = sorted_bound(a, data, false);
+    return pos < a->count && a->compare(a->items[pos], data) == 0 ? a->items[pos] : NULL;
+}
+
+static void sorted_range(void *set, void *minVal, void *maxVal, range_callback_t callback, void *context)
+{
+    SortedArray *a = set;
+    for (long i = sorted_bound(a, minVal, false); i < a->count && a->compare(a->items[i], maxVal) <= 0; i++)
+        callback(a->items[i], context);
+}
+
+static long sorted_count_range(void *set, void *minVal, void *maxVal)
+{
+    SortedArray *a = set;
+    long lo = sorted_bound(a, minVal, false), hi = sorted_bound(a, maxVal, true);
+    return hi > lo ? hi - lo : 0;
+}
+
+static long sorted_rank(void *set, void *data)
+{
+    SortedArray *a = set;
+    long pos = sorted_bound(a, data, false);
+    return pos < a->count && a->compare(a->items[pos], data) == 0 ? pos + 1 : 0;
+}
+
+static void *sorted_kth(void *set, long k)
+{
+    SortedArray *a = set;
+    return k >= 1 && k <= a->count ? a->items[k - 1] : NULL;
+}
+
+// === Registry ===
+const OrderedSet ordered_sets[] = {
+    {"avl", avl_create, avl_destroy, avl_insert, avl_remove, avl_search, avl_range,
+     avl_count_range, avl_rank, avl_kth, 0},
+    {"avl2", avl2_create, avl_destroy, avl_insert, avl_remove, avl_search, avl_range,
+     avl_count_range, avl_rank, avl_kth, 0},
+    {"avl3", avl3_create, avl_destroy, avl_insert, avl_remove, avl_search, avl_range,
+     avl_count_range, avl_rank, avl_kth, 0},
+    {"avl-lazy", avl_lazy_create, avl_destroy, avl_insert, avl_remove, avl_search, avl_range,
+     avl_count_range, avl_rank, avl_kth, 0},
+#ifdef AVL_TOMBSTONES
+    {"avl-tomb", avl_create, avl_destroy, tomb_insert, tomb_remove, avl_search, avl_range,
+     avl_count_range, avl_rank, avl_kth, 0},
+#endif
+    {"wavl", avl_create, avl_destroy, wavl_insert, wavl_remove, avl_search, avl_range,
+     avl_count_range, avl_rank, avl_kth, 0},
+    {"rbtree", rb_create, rb_destroy, rb_insert, rb_remove, rb_search, rb_range,
+     NULL, NULL, NULL, 0},
+    {"skiplist", skip_create, skip_destroy, skip_insert, skip_remove, skip_search, skip_range,
+     NULL, NULL, NULL, 0},
+    {"bptree", bpt_create, bpt_destroy, bpt_insert, bpt_remove, bpt_search, bpt_range,
+     NULL, NULL, NULL, 0},
+    {"sorted", sorted_create, sorted_destroy, sorted_insert, sorted_remove, sorted_search, sorted_range,
+     sorted_count_range, sorted_rank, sorted_kth, 200000},
+};
+
+const int ordered_set_count = sizeof(ordered_sets) / sizeof(ordered_sets[0]);
+
+// fails to compile once the registry outgrows ORDERED_SET_MAX
+typedef char ordered_set_max_check[sizeof(ordered_sets) / sizeof(ordered_sets[0]) <= ORDERED_SET_MAX ? 1 : -1];
+
+const OrderedSet *find_ordered_set(const char *name)
+{
+    for (int i = 0; i < ordered_set_count; i++)
+        if (strcmp(ordered_sets[i].name, name) == 0)
+            return &ordered_sets[i];
+    return NULL;
+}
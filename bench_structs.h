@@ -0,0 +1,37 @@
+#ifndef BENCH_STRUCTS_H
+#define BENCH_STRUCTS_H
+
+#include "AVL.h"
+
+typedef void (*range_callback_t)(const void *data, void *context);
+
+// ordered set interface shared by the AVL tree and the baseline structures the
+// benchmark compares it against; every structure orders keys with compare_func_t
+typedef struct
+{
+    const char *name;
+    void *(*create)(compare_func_t compare);
+    void (*destroy)(void *set);
+    void (*insert)(void *set, void *data);
+    void (*remove)(void *set, void *data);
+    void *(*search)(void *set, void *data);
+    void (*range)(void *set, void *minVal, void *maxVal, range_callback_t callback, void *context);
+
+    // order statistics, NULL for structures without size augmentation
+    long (*count_range)(void *set, void *minVal, void *maxVal);
+    long (*rank)(void *set, void *data);
+    void *(*kth)(void *set, long k);
+
+    // random inserts/deletes above this size are too slow to measure (0 = no limit)
+    long max_write_size;
+} OrderedSet;
+
+// upper bound on the registry, for fixed-size selections of structures
+#define ORDERED_SET_MAX 16
+
+extern const OrderedSet ordered_sets[];
+extern const int ordered_set_count;
+
+const OrderedSet *find_ordered_set(const char *name);
+
+#endif // BENCH_STRUCTS_H
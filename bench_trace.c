@@ -0,0 +1,504 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "AVL.h"
+#include "bench_random.h"
+#include "bench_trace.h"
+#include <time.h>
+
+const char *trace_op_names[TRACE_OP_COUNT] = {"insert", "delete", "search", "range", "rank"};
+
+#define TRACE_HEADER_SIZE 24 // magic[8], version u32, record size u32, count u64
+#define TRACE_RECORD_SIZE 17 // op u8, key i64, arg i64
+
+// === File Format ===
+static void put_u64(unsigned char *p, uint64_t v)
+{
+    for (int i = 0; i < 8; i++)
+        p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static uint64_t get_u64(const unsigned char *p)
+{
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--)
+        v = (v << 8) | p[i];
+    return v;
+}
+
+static void put_u32(unsigned char *p, uint32_t v)
+{
+    for (int i = 0; i < 4; i++)
+        p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static uint32_t get_u32(const unsigned char *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+bool trace_write(const char *path, const TraceRecord *records, uint64_t count)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f)
+    {
+        perror(path);
+        return false;
+    }
+
+    unsigned char header[TRACE_HEADER_SIZE];
+    memcpy(header, TRACE_MAGIC, 8);
+    put_u32(header + 8, TRACE_VERSION);
+    put_u32(header + 12, TRACE_RECORD_SIZE);
+    put_u64(header + 16, count);
+    bool ok = fwrite(header, sizeof(header), 1, f) == 1;
+
+    unsigned char rec[TRACE_RECORD_SIZE];
+    for (uint64_t i = 0; ok && i < count; i++)
+    {
+        rec[0] = records[i].op;
+        put_u64(rec + 1, (uint64_t)records[i].key);
+        put_u64(rec + 9, (uint64_t)records[i].arg);
+        ok = fwrite(rec, sizeof(rec), 1, f) == 1;
+    }
+
+    ok = fclose(f) == 0 && ok;
+    if (!ok)
+        fprintf(stderr, "%s: write failed\n", path);
+    return ok;
+}
+
+TraceRecord *trace_read(const char *path, uint64_t *count)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+    {
+        perror(path);
+        return NULL;
+    }
+
+    unsigned char header[TRACE_HEADER_SIZE];
+    if (fread(header, sizeof(header), 1, f) != 1 || memcmp(header, TRACE_MAGIC, 8) != 0 ||
+        get_u32(header + 8) != TRACE_VERSION || get_u32(header + 12) != TRACE_RECORD_SIZE)
+    {
+        fprintf(stderr, "%s: not an AVL trace file\n", path);
+        fclose(f);
+        return NULL;
+    }
+
+    // the header's count must match the records the file actually holds
+    long size = -1;
+    if (fseek(f, 0, SEEK_END) == 0)
+        size = ftell(f);
+    *count = get_u64(header + 16);
+    if (size < TRACE_HEADER_SIZE || fseek(f, TRACE_HEADER_SIZE, SEEK_SET) != 0 ||
+        *count > (uint64_t)(size - TRACE_HEADER_SIZE) / TRACE_RECORD_SIZE || *count > SIZE_MAX / sizeof(TraceRecord))
+    {
+        fprintf(stderr, "%s: record count %llu does not match the file size\n", path, (unsigned long long)*count);
+        fclose(f);
+        return NULL;
+    }
+
+    TraceRecord *records = malloc((*count ? *count : 1) * sizeof(TraceRecord));
+    if (!records)
+    {
+        perror("Memory allocation failed");
+        fclose(f);
+        return NULL;
+    }
+
+    unsigned char rec[TRACE_RECORD_SIZE];
+    for (uint64_t i = 0; i < *count; i++)
+    {
+        if (fread(rec, sizeof(rec), 1, f) != 1 || rec[0] >= TRACE_OP_COUNT)
+        {
+            fprintf(stderr, "%s: truncated or corrupt record %llu\n", path, (unsigned long long)i);
+            free(records);
+            fclose(f);
+            return NULL;
+        }
+        records[i].op = rec[0];
+        records[i].key = (int64_t)get_u64(rec + 1);
+        records[i].arg = (int64_t)get_u64(rec + 9);
+    }
+
+    fclose(f);
+    return records;
+}
+
+// === Generator ===
+typedef enum
+{
+    DIST_UNIFORM,
+    DIST_ZIPF,
+    DIST_LATEST,
+    DIST_SEQUENTIAL,
+    DIST_COUNT
+} KeyDistribution;
+
+static const char *dist_names[DIST_COUNT] = {"uniform", "zipf", "latest", "sequential"};
+
+typedef struct
+{
+    long load;                // inserts of keys [0, load) in shuffled order
+    long ops;                 // operations after the load phase
+    long keys;                // key space for uniform/zipf inserts (0 = load)
+    int mix[TRACE_OP_COUNT];  // relative weights of the operations
+    KeyDistribution dist;
+    long range_width;
+    double zipf_theta;
+    uint64_t seed;
+    const char *output;
+} GenConfig;
+
+// YCSB core workloads mapped onto the tree's operations (updates become
+// insert/delete pairs since the tree stores keys only)
+typedef struct
+{
+    const char *name;
+    int mix[TRACE_OP_COUNT];
+    KeyDistribution dist;
+} GenPreset;
+
+static const GenPreset presets[] = {
+    {"a", {25, 25, 50, 0, 0}, DIST_ZIPF},   // update heavy
+    {"b", {3, 2, 95, 0, 0}, DIST_ZIPF},     // read mostly
+    {"c", {0, 0, 100, 0, 0}, DIST_ZIPF},    // read only
+    {"d", {5, 0, 95, 0, 0}, DIST_LATEST},   // read latest
+    {"e", {5, 0, 0, 95, 0}, DIST_ZIPF},     // short ranges
+    {"f", {0, 0, 50, 0, 50}, DIST_UNIFORM}, // read and rank
+};
+
+static void generate_usage(void)
+{
+    fprintf(stderr,
+            "Usage: benchmark generate --output=FILE [options]\n"
+            "  --preset=a|b|c|d|e|f  YCSB-style operation mix and distribution\n"
+            "  --mix=OP:W[,OP:W...]  weights for insert,delete,search,range,rank\n"
+            "  --dist=NAME           uniform, zipf, latest or sequential (default uniform)\n"
+            "  --load=N              keys inserted before the measured operations (default 100000)\n"
+            "  --ops=N               operations after the load phase (default 1000000)\n"
+            "  --keys=N              key space for uniform/zipf inserts (default: load)\n"
+            "  --range-width=N       keys covered by range operations (default 100)\n"
+            "  --zipf-theta=X        zipfian skew (default 0.99)\n"
+            "  --seed=N              random seed\n");
+}
+
+static bool parse_mix(GenConfig *cfg, const char *list)
+{
+    memset(cfg->mix, 0, sizeof(cfg->mix));
+    char *copy = malloc(strlen(list) + 1);
+    if (!copy)
+        return false;
+    strcpy(copy, list);
+
+    bool ok = true;
+    for (char *tok = strtok(copy, ","); tok && ok; tok = strtok(NULL, ","))
+    {
+        char *colon = strchr(tok, ':');
+        ok = false;
+        if (!colon)
+            break;
+        *colon = '\0';
+        for (int op = 0; op < TRACE_OP_COUNT; op++)
+        {
+            if (strcmp(tok, trace_op_names[op]) == 0)
+            {
+                cfg->mix[op] = atoi(colon + 1);
+                ok = cfg->mix[op] >= 0;
+            }
+        }
+    }
+    free(copy);
+    return ok;
+}
+
+static bool parse_generate_args(GenConfig *cfg, int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const char *val = strchr(arg, '=');
+        if (!val)
+            return false;
+        val++;
+
+        if (strncmp(arg, "--preset=", 9) == 0)
+        {
+            bool found = false;
+            for (size_t p = 0; p < sizeof(presets) / sizeof(presets[0]); p++)
+            {
+                if (strcmp(val, presets[p].name) == 0)
+                {
+                    memcpy(cfg->mix, presets[p].mix, sizeof(cfg->mix));
+                    cfg->dist = presets[p].dist;
+                    found = true;
+                }
+            }
+            if (!found)
+                return false;
+        }
+        else if (strncmp(arg, "--mix=", 6) == 0)
+        {
+            if (!parse_mix(cfg, val))
+                return false;
+        }
+        else if (strncmp(arg, "--dist=", 7) == 0)
+        {
+            int d = 0;
+            while (d < DIST_COUNT && strcmp(val, dist_names[d]) != 0)
+                d++;
+            if (d == DIST_COUNT)
+                return false;
+            cfg->dist = (KeyDistribution)d;
+        }
+        else if (strncmp(arg, "--load=", 7) == 0)
+            cfg->load = atol(val);
+        else if (strncmp(arg, "--ops=", 6) == 0)
+            cfg->ops = atol(val);
+        else if (strncmp(arg, "--keys=", 7) == 0)
+            cfg->keys = atol(val);
+        else if (strncmp(arg, "--range-width=", 14) == 0)
+            cfg->range_width = atol(val);
+        else if (strncmp(arg, "--zipf-theta=", 13) == 0)
+            cfg->zipf_theta = atof(val);
+        else if (strncmp(arg, "--seed=", 7) == 0)
+            cfg->seed = strtoull(val, NULL, 10);
+        else if (strncmp(arg, "--output=", 9) == 0)
+            cfg->output = val;
+        else
+            return false;
+    }
+
+    int total = 0;
+    for (int op = 0; op < TRACE_OP_COUNT; op++)
+        total += cfg->mix[op];
+    return cfg->output && total > 0 && cfg->load >= 0 && cfg->ops >= 0 && cfg->keys >= 0 &&
+           cfg->load <= INT_MAX && cfg->keys <= INT_MAX && cfg->range_width > 0 &&
+           cfg->zipf_theta > 0.0 && cfg->zipf_theta < 1.0;
+}
+
+int trace_generate_main(int argc, char **argv)
+{
+    GenConfig cfg = {
+        .load = 100000,
+        .ops = 1000000,
+        .mix = {5, 5, 80, 5, 5},
+        .dist = DIST_UNIFORM,
+        .range_width = 100,
+        .zipf_theta = 0.99,
+        .seed = 42,
+    };
+    if (!parse_generate_args(&cfg, argc, argv))
+    {
+        generate_usage();
+        return EXIT_FAILURE;
+    }
+
+    long space = cfg.keys ? cfg.keys : (cfg.load ? cfg.load : 1);
+    uint64_t count = (uint64_t)(cfg.load + cfg.ops);
+    TraceRecord *records = malloc((count ? count : 1) * sizeof(TraceRecord));
+    if (!records)
+    {
+        perror("Memory allocation failed");
+        return EXIT_FAILURE;
+    }
+    rng_seed(cfg.seed);
+
+    // load phase: every key of [0, load) once, shuffled
+    for (long i = 0; i < cfg.load; i++)
+        records[i] = (TraceRecord){TRACE_INSERT, i, 0};
+    for (long i = cfg.load - 1; i > 0; i--)
+    {
+        long j = (long)(rng_next() % (uint64_t)(i + 1));
+        TraceRecord tmp = records[i];
+        records[i] = records[j];
+        records[j] = tmp;
+    }
+
+    Zipf zipf;
+    if (cfg.dist == DIST_ZIPF || cfg.dist == DIST_LATEST)
+        zipf_init(&zipf, (int)space, cfg.zipf_theta);
+
+    int total = 0;
+    for (int op = 0; op < TRACE_OP_COUNT; op++)
+        total += cfg.mix[op];
+
+    // keys [0, next) have been inserted at some point; sequential and latest
+    // traces always insert fresh keys, uniform and zipf draw from the key space
+    int64_t next = cfg.load, cursor = 0;
+    for (long i = 0; i < cfg.ops; i++)
+    {
+        int dice = rng_below(total), op = 0;
+        while (dice >= cfg.mix[op])
+            dice -= cfg.mix[op++];
+
+        int64_t bound = next > 0 ? next : 1, key;
+        if (op == TRACE_INSERT && (cfg.dist == DIST_SEQUENTIAL || cfg.dist == DIST_LATEST))
+            key = next++;
+        else if (op == TRACE_INSERT)
+            key = (int64_t)(rng_next() % (uint64_t)space);
+        else if (cfg.dist == DIST_UNIFORM)
+            key = (int64_t)(rng_next() % (uint64_t)bound);
+        else if (cfg.dist == DIST_ZIPF)
+            key = (int64_t)(((uint64_t)zipf_next(&zipf) * 2654435761ULL) % (uint64_t)bound);
+        else if (cfg.dist == DIST_LATEST)
+        {
+            key = bound - 1 - zipf_next(&zipf);
+            if (key < 0)
+                key = 0;
+        }
+        else
+            key = cursor++ % bound;
+
+        if (op == TRACE_INSERT && key >= next)
+            next = key + 1;
+        records[cfg.load + i] = (TraceRecord){(uint8_t)op, key, op == TRACE_RANGE ? cfg.range_width : 0};
+    }
+
+    bool ok = trace_write(cfg.output, records, count);
+    if (ok)
+        fprintf(stderr, "wrote %llu operations (%ld load + %ld %s) to %s\n", (unsigned long long)count,
+                cfg.load, cfg.ops, dist_names[cfg.dist], cfg.output);
+    free(records);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// === Replay ===
+// replay always reports nanoseconds, whatever clock latencyClock() uses
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+static int int64_compare(const void *a, const void *b)
+{
+    int64_t ia = *(const int64_t *)a, ib = *(const int64_t *)b;
+    return (ia > ib) - (ia < ib);
+}
+
+static void count_callback(const void *data, void *context)
+{
+    (void)data;
+    (*(long *)context)++;
+}
+
+static void replay_usage(void)
+{
+    fprintf(stderr,
+            "Usage: benchmark replay FILE [options]\n"
+            "  --skip-load=N         replay the first N records untimed (e.g. the load phase)\n"
+            "  --format=FMT          text, csv or json (default text)\n");
+}
+
+int trace_replay_main(int argc, char **argv)
+{
+    const char *path = NULL, *format = "text";
+    long skip = 0;
+    bool ok = true;
+    for (int i = 1; i < argc && ok; i++)
+    {
+        if (strncmp(argv[i], "--skip-load=", 12) == 0)
+            skip = atol(argv[i] + 12);
+        else if (strncmp(argv[i], "--format=", 9) == 0)
+            format = argv[i] + 9;
+        else if (argv[i][0] != '-' && !path)
+            path = argv[i];
+        else
+            ok = false;
+    }
+    if (!ok || !path || skip < 0 ||
+        (strcmp(format, "text") != 0 && strcmp(format, "csv") != 0 && strcmp(format, "json") != 0))
+    {
+        replay_usage();
+        return EXIT_FAILURE;
+    }
+
+    uint64_t count;
+    TraceRecord *records = trace_read(path, &count);
+    if (!records)
+        return EXIT_FAILURE;
+
+    // the tree points straight at the keys inside the record array
+    AVLNode *root = NULL;
+    AVLHistogram hist[TRACE_OP_COUNT];
+    unsigned long long total_ticks[TRACE_OP_COUNT] = {0};
+    for (int op = 0; op < TRACE_OP_COUNT; op++)
+        histogramReset(&hist[op]);
+
+    long acc = 0;
+    for (uint64_t i = 0; i < count; i++)
+    {
+        TraceRecord *r = &records[i];
+        // a range past INT64_MAX (only in a corrupt trace) is cut off there
+        int64_t width = r->arg > 0 ? r->arg - 1 : 0;
+        int64_t hi = r->key > INT64_MAX - width ? INT64_MAX : r->key + width;
+        unsigned long long start = now_ns();
+        switch (r->op)
+        {
+        case TRACE_INSERT:
+            root = insert(root, &r->key, int64_compare);
+            break;
+        case TRACE_DELETE:
+            root = delete(root, &r->key, int64_compare, NULL);
+            break;
+        case TRACE_SEARCH:
+            acc += search(root, &r->key, int64_compare) != NULL;
+            break;
+        case TRACE_RANGE:
+            rangeQuery(root, &r->key, &hi, int64_compare, count_callback, &acc);
+            break;
+        case TRACE_RANK:
+            acc += getRank(root, &r->key, int64_compare);
+            break;
+        }
+        unsigned long long ticks = now_ns() - start;
+        if (i >= (uint64_t)skip)
+        {
+            histogramRecord(&hist[r->op], ticks);
+            total_ticks[r->op] += ticks;
+        }
+    }
+
+    bool json = strcmp(format, "json") == 0, csv = strcmp(format, "csv") == 0;
+    if (csv)
+        printf("op,count,ops_per_sec,mean_ns,p50,p99,p999,max\n");
+    else if (json)
+        printf("[");
+    else
+        printf("%-8s %10s %14s %10s %8s %8s %8s %10s\n", "op", "count", "ops/sec", "mean", "p50", "p99",
+               "p99.9", "max");
+
+    bool first = true;
+    for (int op = 0; op < TRACE_OP_COUNT; op++)
+    {
+        const AVLHistogram *h = &hist[op];
+        if (h->total == 0)
+            continue;
+        double mean = (double)total_ticks[op] / h->total;
+        double ops_per_sec = total_ticks[op] ? h->total * 1e9 / total_ticks[op] : 0.0;
+        unsigned long long p50 = histogramPercentile(h, 50.0), p99 = histogramPercentile(h, 99.0);
+        unsigned long long p999 = histogramPercentile(h, 99.9);
+
+        if (csv)
+            printf("%s,%llu,%.1f,%.1f,%llu,%llu,%llu,%llu\n", trace_op_names[op], h->total, ops_per_sec,
+                   mean, p50, p99, p999, h->max);
+        else if (json)
+            printf("%s\n  {\"op\": \"%s\", \"count\": %llu, \"ops_per_sec\": %.1f, \"mean_ns\": %.1f, "
+                   "\"p50\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu}",
+                   first ? "" : ",", trace_op_names[op], h->total, ops_per_sec, mean, p50, p99, p999, h->max);
+        else
+            printf("%-8s %10llu %14.0f %10.1f %8llu %8llu %8llu %10llu\n", trace_op_names[op], h->total,
+                   ops_per_sec, mean, p50, p99, p999, h->max);
+        first = false;
+    }
+    if (json)
+        printf("\n]\n");
+
+    fprintf(stderr, "replayed %llu operations, final tree size %lld (checksum %ld)\n",
+            (unsigned long long)count, (long long)getSize(root), acc);
+    freeAVLTree(root, NULL);
+    free(records);
+    return EXIT_SUCCESS;
+}
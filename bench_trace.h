@@ -0,0 +1,37 @@
+#ifndef BENCH_TRACE_H
+#define BENCH_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// operation traces: a fixed header followed by fixed-size little-endian records
+#define TRACE_MAGIC "AVLTRACE"
+#define TRACE_VERSION 1
+
+typedef enum
+{
+    TRACE_INSERT,
+    TRACE_DELETE,
+    TRACE_SEARCH,
+    TRACE_RANGE, // arg: number of keys covered
+    TRACE_RANK,
+    TRACE_OP_COUNT
+} TraceOp;
+
+typedef struct
+{
+    uint8_t op;
+    int64_t key;
+    int64_t arg;
+} TraceRecord;
+
+extern const char *trace_op_names[TRACE_OP_COUNT];
+
+bool trace_write(const char *path, const TraceRecord *records, uint64_t count);
+TraceRecord *trace_read(const char *path, uint64_t *count); // NULL on error
+
+// `benchmark generate ...` and `benchmark replay ...`
+int trace_generate_main(int argc, char **argv);
+int trace_replay_main(int argc, char **argv);
+
+#endif // BENCH_TRACE_H
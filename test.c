@@ -269,6 +269,867 @@ TEST(queries)
     free(arr);
 }
 
+TEST(op_stats)
+{
+    resetOpStats();
+    AVLNode *root = NULL;
+    for (int i = 1; i <= 3; i++)
+        root = insert(root, create_int(i), int_compare);
+    int key = 3;
+    search(root, &key, int_compare);
+
+    AVLOpStats s;
+    getOpStats(&s);
+#ifdef AVL_STATS
+    ASSERT(s.allocations == 3, "Stats: allocations counted");
+    ASSERT(s.singleRotations == 1 && s.doubleRotations == 0, "Stats: one single rotation");
+    ASSERT(s.comparisons == 5, "Stats: comparator calls counted");
+    ASSERT(s.depth[AVL_OP_INSERT].count == 3 && s.depth[AVL_OP_INSERT].maxDepth == 2,
+           "Stats: insert descent depth");
+    ASSERT(s.depth[AVL_OP_SEARCH].totalDepth == 2, "Stats: search descent depth");
+
+    freeAVLTree(root, int_free);
+    getOpStats(&s);
+    ASSERT(s.frees == 3, "Stats: frees counted");
+
+    resetOpStats();
+    getOpStats(&s);
+    ASSERT(s.comparisons == 0 && s.allocations == 0, "Stats: reset clears counters");
+#else
+    ASSERT(s.comparisons == 0 && s.allocations == 0, "Stats: counters stay zero when disabled");
+    freeAVLTree(root, int_free);
+#endif
+}
+
+TEST(latency_histogram)
+{
+    AVLHistogram a, b;
+    histogramReset(&a);
+    histogramReset(&b);
+    for (unsigned long long v = 1; v <= 1000; v++)
+        histogramRecord(v % 2 ? &a : &b, v);
+
+    histogramMerge(&a, &b);
+    ASSERT(a.total == 1000 && a.min == 1 && a.max == 1000, "Histogram: merge keeps count, min and max");
+
+    unsigned long long p50 = histogramPercentile(&a, 50.0);
+    unsigned long long p99 = histogramPercentile(&a, 99.0);
+    ASSERT(p50 >= 500 && p50 <= 516, "Histogram: p50 within bucket precision");
+    ASSERT(p99 >= 990 && p99 <= 1000, "Histogram: p99 within bucket precision");
+    ASSERT(histogramPercentile(&a, 100.0) == 1000, "Histogram: p100 is the maximum");
+
+    AVLLatencyRecorder recorder;
+    latencyRecorderReset(&recorder);
+    setLatencyRecorder(&recorder);
+    AVLNode *root = NULL;
+    for (int i = 0; i < 100; i++)
+        root = insert(root, create_int(i), int_compare);
+    int key = 42;
+    search(root, &key, int_compare);
+    root = delete(root, &key, int_compare, int_free);
+    setLatencyRecorder(NULL);
+#ifdef AVL_LATENCY
+    ASSERT(recorder.ops[AVL_OP_INSERT].total == 100 && recorder.ops[AVL_OP_SEARCH].total == 1 &&
+               recorder.ops[AVL_OP_DELETE].total == 1,
+           "Histogram: operations recorded per type");
+#else
+    ASSERT(recorder.ops[AVL_OP_INSERT].total == 0, "Histogram: nothing recorded when disabled");
+#endif
+
+    freeAVLTree(root, int_free);
+}
+
+static int int_format(char *buf, size_t size, const void *data)
+{
+    return snprintf(buf, size, "%d", *(const int *)data);
+}
+
+static void read_back(FILE *f, char *buf, size_t size)
+{
+    rewind(f);
+    size_t n = fread(buf, 1, size - 1, f);
+    buf[n] = '\0';
+    rewind(f);
+}
+
+TEST(buffered_dump)
+{
+    int values[] = {4, 2, 6, 1, 3, 5};
+    AVLNode *root = NULL;
+    for (int i = 0; i < 6; i++)
+        root = insert(root, create_int(values[i]), int_compare);
+
+    FILE *f = tmpfile();
+    ASSERT(f != NULL, "Dump: temporary file");
+    if (!f)
+        return;
+    char buf[512];
+
+    ASSERT(dumpTraversal(root, AVL_INORDER, f, int_format), "Dump: inorder succeeds");
+    read_back(f, buf, sizeof(buf));
+    ASSERT(strcmp(buf, "1 2 3 4 5 6\n") == 0, "Dump: inorder output");
+
+    ASSERT(dumpTraversal(root, AVL_POSTORDER, f, int_format), "Dump: postorder succeeds");
+    read_back(f, buf, sizeof(buf));
+    ASSERT(strncmp(buf, "1 3 2 5 6 4\n", 12) == 0, "Dump: postorder output");
+
+    ASSERT(dumpAVL(root, f, int_format), "Dump: tree diagram succeeds");
+    read_back(f, buf, sizeof(buf));
+    ASSERT(strncmp(buf, "└── 4 [h:3,b:+0]\n    ├── 6 [h:2,b:+1]\n    │   └── 5 [h:1,b:+0]\n", 64) == 0,
+           "Dump: tree diagram layout");
+    fclose(f);
+    freeAVLTree(root, int_free);
+
+    // a 100-node right spine is deeper than the on-stack walk buffers
+    AVLNode *spine = NULL;
+    for (int i = 100; i >= 1; i--)
+    {
+        AVLNode *node = createNode(create_int(i));
+        node->right = spine;
+        updateHeight(node);
+        updateSize(node);
+        spine = node;
+    }
+    f = tmpfile();
+    ASSERT(f && dumpTraversal(spine, AVL_PREORDER, f, int_format), "Dump: deep tree uses heap stack");
+    if (f)
+    {
+        read_back(f, buf, sizeof(buf));
+        ASSERT(strncmp(buf, "1 2 3 ", 6) == 0 && strstr(buf, " 99 100\n") != NULL, "Dump: deep tree output");
+        fclose(f);
+    }
+    freeAVLTree(spine, int_free);
+}
+
+typedef struct
+{
+    int values[16];
+    int count, limit;
+} VisitLog;
+
+static int log_visit(const void *data, void *context)
+{
+    VisitLog *log = context;
+    log->values[log->count++] = *(const int *)data;
+    return log->count == log->limit ? 7 : 0;
+}
+
+TEST(visitor_traversal)
+{
+    int values[] = {4, 2, 6, 1, 3, 5, 7};
+    AVLNode *root = NULL;
+    for (int i = 0; i < 7; i++)
+        root = insert(root, create_int(values[i]), int_compare);
+
+    static const int expected[3][7] = {{1, 2, 3, 4, 5, 6, 7}, {4, 2, 1, 3, 6, 5, 7}, {1, 3, 2, 5, 7, 6, 4}};
+    static const AVLOrder orders[3] = {AVL_INORDER, AVL_PREORDER, AVL_POSTORDER};
+    for (int o = 0; o < 3; o++)
+    {
+        VisitLog log = {.limit = -1};
+        ASSERT(visitAVL(root, orders[o], log_visit, &log) == 0 && log.count == 7 &&
+                   memcmp(log.values, expected[o], sizeof(expected[o])) == 0,
+               "Visitor: full walk in order");
+
+        log = (VisitLog){.limit = 3};
+        ASSERT(visitAVL(root, orders[o], log_visit, &log) == 7 && log.count == 3 &&
+                   memcmp(log.values, expected[o], 3 * sizeof(int)) == 0,
+               "Visitor: early exit returns the callback's code");
+    }
+
+    VisitLog log = {.limit = -1};
+    ASSERT(visitAVL(NULL, AVL_INORDER, log_visit, &log) == 0 && log.count == 0, "Visitor: empty tree");
+    freeAVLTree(root, int_free);
+}
+
+static void log_range(const void *data, void *context)
+{
+    log_visit(data, context);
+}
+
+TEST(morris_traversal)
+{
+    AVLNode *root = NULL;
+    for (int i = 1; i <= 15; i++)
+        root = insert(root, create_int(i), int_compare);
+
+    VisitLog log = {.limit = -1};
+    ASSERT(visitAVLMorris(root, log_visit, &log) == 0 && log.count == 15 && log.values[0] == 1 &&
+               log.values[14] == 15,
+           "Morris: full in-order walk");
+
+    log = (VisitLog){.limit = 5};
+    ASSERT(visitAVLMorris(root, log_visit, &log) == 7 && log.count == 5 && log.values[4] == 5,
+           "Morris: early exit");
+    validate_avl(root, "Morris: threads removed after early exit");
+    log = (VisitLog){.limit = -1};
+    visitAVL(root, AVL_INORDER, log_visit, &log);
+    ASSERT(log.count == 15 && log.values[7] == 8, "Morris: tree intact after early exit");
+
+    int lo = 4, hi = 9;
+    log = (VisitLog){.limit = -1};
+    rangeQueryMorris(root, &lo, &hi, int_compare, log_range, &log);
+    ASSERT(log.count == 6 && log.values[0] == 4 && log.values[5] == 9, "Morris: range query");
+    validate_avl(root, "Morris: tree valid after range query");
+
+    freeAVLTree(root, int_free);
+}
+
+TEST(node_handles)
+{
+    AVLNode *root = NULL;
+    for (int i = 1; i <= 7; i++)
+        root = insert(root, create_int(i), int_compare);
+
+    // deleting a node with two children moves its successor's node, not its data
+    int key = 5;
+    AVLNode *five = search(root, &key, int_compare);
+    key = 4;
+    root = delete(root, &key, int_compare, int_free);
+    key = 5;
+    ASSERT(search(root, &key, int_compare) == five && *(int *)five->data == 5, "Handles: successor node survives delete");
+    validate_avl(root, "Handles: tree valid after two-child delete");
+
+#ifdef AVL_PARENT_POINTERS
+    ASSERT(root->parent == NULL, "Parents: root has no parent");
+    static const int remaining[] = {1, 2, 3, 5, 6, 7};
+    int seen = 0;
+    bool ordered = true;
+    for (AVLNode *node = findMin(root); node; node = avlNext(node))
+        ordered = ordered && seen < 6 && *(int *)node->data == remaining[seen++];
+    ASSERT(ordered && seen == 6, "Parents: avlNext walks in order");
+    ASSERT(avlPrev(five) && *(int *)avlPrev(five)->data == 3, "Parents: avlPrev");
+
+    for (int i = 8; i <= 40; i++)
+        root = insert(root, create_int(i), int_compare);
+    while (getSize(root) > 10)
+        root = deleteNode(root, findKthSmallest(root, getSize(root) / 3 + 1), int_free);
+    validate_avl(root, "Parents: deleteNode keeps the tree balanced");
+    ASSERT(getSize(root) == 10 && root->parent == NULL, "Parents: deleteNode updates sizes and root");
+#endif
+
+    freeAVLTree(root, int_free);
+}
+
+TEST(delete_by_path)
+{
+    AVLNode *root = NULL;
+    for (int i = 1; i <= 31; i++)
+        root = insert(root, create_int(i), int_compare);
+
+    AVLPath path;
+    int key = 16; // the root, with two children
+    AVLNode *found = searchPath(root, &key, int_compare, &path);
+    ASSERT(found == root && path.length == 1, "Path: search records the root");
+    resetOpStats();
+    root = deletePath(root, &path, int_free);
+    AVLOpStats s;
+    getOpStats(&s);
+    ASSERT(path.length == 0, "Path: delete consumes the path");
+#ifdef AVL_STATS
+    ASSERT(s.comparisons == 0, "Path: delete makes no comparator calls");
+#endif
+    ASSERT(!search(root, &key, int_compare) && getSize(root) == 30, "Path: key removed");
+    validate_avl(root, "Path: tree valid after root delete");
+
+    key = 31;
+    ASSERT(searchPath(root, &key, int_compare, &path) && path.length == 5, "Path: leaf path runs root to leaf");
+    root = deletePath(root, &path, int_free);
+    key = 99;
+    ASSERT(!searchPath(root, &key, int_compare, &path) && path.length == 0, "Path: missing key gives empty path");
+    ASSERT(deletePath(root, &path, int_free) == root && getSize(root) == 29, "Path: empty path deletes nothing");
+
+    AVLNode *min;
+    root = removeMin(root, &min);
+    ASSERT(min && *(int *)min->data == 1 && !min->left && !min->right && getSize(min) == 1,
+           "Path: removeMin detaches the smallest node");
+    ASSERT(getSize(root) == 28 && *(int *)findMin(root)->data == 2, "Path: removeMin leaves the rest");
+    validate_avl(root, "Path: tree valid after removeMin");
+    freeAVLTree(min, int_free);
+
+    while (root)
+    {
+        root = removeMin(root, &min);
+        freeAVLTree(min, int_free);
+    }
+    ASSERT(removeMin(NULL, &min) == NULL && min == NULL, "Path: removeMin on empty tree");
+}
+
+TEST(relaxed_balance)
+{
+    // AVL(2) leaves a three-node chain alone; the fourth node forces a rotation
+    AVLNode *root = NULL;
+    for (int i = 1; i <= 3; i++)
+        root = insertRelaxed(root, create_int(i), int_compare, 2);
+    ASSERT(getHeight(root) == 3 && *(int *)root->data == 1, "Relaxed: chain of three within balance 2");
+    ASSERT(!isValidAVL(root) && isValidAVLRelaxed(root, 2), "Relaxed: valid only as an AVL(2) tree");
+    root = insertRelaxed(root, create_int(4), int_compare, 2);
+    ASSERT(getHeight(root) == 3 && *(int *)root->data == 2, "Relaxed: rotation once balance exceeds 2");
+    freeAVLTree(root, int_free);
+
+    // looser trees rotate less and grow taller
+    int heights[3];
+    for (int k = 1; k <= 3; k++)
+    {
+        root = NULL;
+        for (int i = 0; i < 4096; i++)
+            root = insertRelaxed(root, create_int((i * 2654435761u) % 4096), int_compare, k);
+        for (int i = 0; i < 4096; i += 3)
+            root = deleteRelaxed(root, &i, int_compare, int_free, k);
+        heights[k - 1] = getHeight(root);
+        ASSERT(isValidAVLRelaxed(root, k) && isValidBST(root, NULL, NULL, int_compare) &&
+                   getSize(root) == 4096 - 1366,
+               "Relaxed: inserts and deletes keep the AVL(k) invariant");
+        freeAVLTree(root, int_free);
+    }
+    ASSERT(heights[0] <= heights[1] && heights[1] <= heights[2], "Relaxed: height grows with the balance");
+
+    // out-of-range balances are clamped, 0 meaning strict
+    root = NULL;
+    for (int i = 1; i <= 3; i++)
+        root = insertRelaxed(root, create_int(i), int_compare, 0);
+    ASSERT(isValidAVL(root) && getHeight(root) == 2, "Relaxed: balance 0 clamps to a strict tree");
+    freeAVLTree(root, int_free);
+}
+
+TEST(deferred_rebalance)
+{
+    // a sequential burst at the loosest balance leaves marked, unbalanced subtrees
+    AVLNode *root = NULL;
+    for (int i = 0; i < 1000; i++)
+        root = insertRelaxed(root, create_int(i), int_compare, AVL_RELAXED_BALANCE_MAX);
+    for (int i = 0; i < 1000; i += 4)
+        root = deleteRelaxed(root, &i, int_compare, int_free, AVL_RELAXED_BALANCE_MAX);
+    ASSERT(needsRebalance(root) && !isValidAVL(root), "Deferred: relaxed updates leave pending work");
+    ASSERT(isValidAVLRelaxed(root, AVL_RELAXED_BALANCE_MAX), "Deferred: marks cover every unbalanced node");
+
+    root = rebalanceAll(root);
+    ASSERT(!needsRebalance(root) && isValidAVL(root) && isValidBST(root, NULL, NULL, int_compare) &&
+               getSize(root) == 750,
+           "Deferred: rebalanceAll restores the AVL invariant");
+
+    // a balanced tree has nothing to do
+    AVLNode *same = rebalanceAll(root);
+    ASSERT(same == root && !needsRebalance(NULL), "Deferred: clean tree is left alone");
+    freeAVLTree(root, int_free);
+}
+
+TEST(weak_avl)
+{
+    // without deletes a WAVL tree is an AVL tree with ranks equal to heights
+    AVLNode *root = NULL;
+    for (int i = 0; i < 2048; i++)
+        root = wavlInsert(root, create_int((i * 2654435761u) % 2048), int_compare);
+    ASSERT(isValidAVL(root) && isValidWAVL(root), "WAVL: insert-only tree is an AVL tree");
+
+    unsigned long long maxRotations = 0;
+    for (int i = 0; i < 2048; i += 2)
+    {
+        AVLOpStats before, after;
+        getOpStats(&before);
+        root = wavlDelete(root, &i, int_compare, int_free);
+        getOpStats(&after);
+        unsigned long long rotations = after.singleRotations - before.singleRotations +
+                                       after.doubleRotations - before.doubleRotations;
+        if (rotations > maxRotations)
+            maxRotations = rotations;
+    }
+    ASSERT(isValidWAVL(root) && isValidBST(root, NULL, NULL, int_compare) && getSize(root) == 1024,
+           "WAVL: deletes keep rank rules and sizes");
+#ifdef AVL_STATS
+    ASSERT(maxRotations <= 1, "WAVL: at most one single or double rotation per delete");
+#endif
+
+    int key = 1023;
+    ASSERT(search(root, &key, int_compare) && findKthSmallest(root, 512) &&
+               *(int *)findKthSmallest(root, 512)->data == 1023,
+           "WAVL: queries work unchanged");
+    for (int i = 1; i < 2048; i += 2)
+        root = wavlDelete(root, &i, int_compare, int_free);
+    ASSERT(root == NULL, "WAVL: tree empties");
+}
+
+TEST(tombstones)
+{
+#ifdef AVL_TOMBSTONES
+    AVLNode *root = NULL;
+    for (int i = 1; i <= 20; i++)
+        root = insert(root, create_int(i), int_compare);
+
+    resetOpStats();
+    int key = 5;
+    root = tombstoneDelete(root, &key, int_compare, int_free);
+    AVLOpStats s;
+    getOpStats(&s);
+    ASSERT(s.singleRotations + s.doubleRotations == 0 && s.frees == 0, "Tombstones: delete leaves the node in place");
+    ASSERT(!search(root, &key, int_compare) && getSize(root) == 20 && getLiveSize(root) == 19,
+           "Tombstones: deleted key hidden from search");
+    int six = 6, lo = 1, hi = 10;
+    ASSERT(getRank(root, &six, int_compare) == 5 && getRank(root, &key, int_compare) == 0 &&
+               *(int *)findKthSmallest(root, 5)->data == 6 && countRange(root, &lo, &hi, int_compare) == 9,
+           "Tombstones: ranks and counts skip the tombstone");
+
+    // re-inserting the key revives the node without allocating
+    AVLNode *node = root;
+    while (*(int *)node->data != 5)
+        node = 5 < *(int *)node->data ? node->left : node->right;
+    resetOpStats();
+    root = insertRevive(root, create_int(5), int_compare, int_free);
+    getOpStats(&s);
+    ASSERT(search(root, &key, int_compare) == node && getLiveSize(root) == 20, "Tombstones: re-insert revives the node");
+    ASSERT(s.allocations == 0 && s.frees == 0, "Tombstones: revive allocates nothing");
+
+    // passing AVL_TOMBSTONE_RATIO triggers compaction
+    int deleted = 0;
+    for (int i = 1; i <= 20 && getSize(root) == 20; i += 2, deleted++)
+        root = tombstoneDelete(root, &i, int_compare, int_free);
+    ASSERT(deleted == 6 && getSize(root) == 14 && getLiveSize(root) == 14, "Tombstones: compaction past the ratio");
+    validate_avl(root, "Tombstones: compacted tree is balanced");
+
+    for (int i = 2; i <= 6; i += 2)
+        root = tombstoneDelete(root, &i, int_compare, int_free);
+    root = compactTombstones(root, int_free);
+    ASSERT(getSize(root) == 11 && getLiveSize(root) == 11 && isValidAVL(root),
+           "Tombstones: explicit compaction");
+    freeAVLTree(root, int_free);
+#else
+    AVLNode *root = insert(NULL, create_int(1), int_compare);
+    ASSERT(getLiveSize(root) == getSize(root), "Tombstones: live size is the size when disabled");
+    freeAVLTree(root, int_free);
+#endif
+}
+
+TEST(partial_rebuild)
+{
+    AVLNode *root = NULL;
+    for (int i = 0; i < 1000; i++)
+        root = insert(root, create_int(i * 7919 % 1000), int_compare);
+
+    // the rebuilt tree is perfectly balanced with its nodes laid out in key order
+    root = rebuildSubtree(root);
+    validate_avl(root, "Rebuild: tree valid after rebuild");
+    ASSERT(getSize(root) == 1000 && getHeight(root) == 10, "Rebuild: perfectly balanced");
+    AVLNode *first = findMin(root);
+    bool contiguous = true;
+    for (avl_size_t k = 1; k <= 1000; k++)
+        contiguous = contiguous && findKthSmallest(root, k) == first + (k - 1);
+    ASSERT(contiguous, "Rebuild: nodes contiguous in key order");
+
+    // a child subtree can be rebuilt on its own; block nodes are freed one by one
+    root->left = rebuildSubtree(root->left);
+    validate_avl(root, "Rebuild: subtree rebuild keeps the tree valid");
+    for (int i = 0; i < 1000; i += 2)
+        root = delete(root, &i, int_compare, int_free);
+    for (int i = 1000; i < 1100; i++)
+        root = insert(root, create_int(i), int_compare);
+    ASSERT(getSize(root) == 600 && isValidAVL(root), "Rebuild: block nodes delete and mix with new ones");
+    freeAVLTree(root, int_free);
+    ASSERT(rebuildSubtree(NULL) == NULL, "Rebuild: empty subtree");
+
+    // with AVL_AUTO_REBUILD relaxed trees rebuild subtrees that grow too tall; without it
+    // relaxed updates never move a node
+    root = NULL;
+#ifndef AVL_AUTO_REBUILD
+    AVLNode *held = NULL;
+    int zero = 0;
+#endif
+    for (int i = 0; i < 20000; i++)
+    {
+        root = insertRelaxed(root, create_int((int)((i * 2654435761u) % 100000)), int_compare,
+                             AVL_RELAXED_BALANCE_MAX);
+#ifndef AVL_AUTO_REBUILD
+        if (i == 0)
+            held = search(root, &zero, int_compare);
+#endif
+    }
+    AVLTreeStats s;
+    avlStats(root, NULL, &s);
+#ifdef AVL_AUTO_REBUILD
+    ASSERT(s.heightRatio <= AVL_REBUILD_HEIGHT_RATIO && isValidBST(root, NULL, NULL, int_compare),
+           "Rebuild: relaxed tree kept within the height ratio");
+#else
+    ASSERT(held && search(root, &zero, int_compare) == held && isValidBST(root, NULL, NULL, int_compare),
+           "Rebuild: relaxed updates keep nodes in place");
+#endif
+    freeAVLTree(root, int_free);
+}
+
+TEST(compact_tree)
+{
+    AVLLayout layouts[] = {AVL_LAYOUT_BFS, AVL_LAYOUT_VEB};
+    for (int l = 0; l < 2; l++)
+    {
+        AVLNode *root = NULL;
+        for (int i = 0; i < 1000; i++)
+            root = insert(root, create_int(i * 7919 % 1000), int_compare);
+        for (int i = 0; i < 1000; i += 3)
+            root = delete(root, &i, int_compare, int_free);
+        int height = getHeight(root);
+        avl_size_t size = getSize(root);
+
+        // the shape is kept; only the node addresses change
+        root = compactTree(root, layouts[l]);
+        validate_avl(root, "Compact: tree valid after compaction");
+        ASSERT(getHeight(root) == height && getSize(root) == size, "Compact: shape unchanged");
+        ASSERT(root->left == root + 1 && root->right == root + 2, "Compact: root's children follow it");
+        if (layouts[l] == AVL_LAYOUT_BFS)
+            ASSERT(root->left->right == root + 4, "Compact: BFS lays out level by level");
+        else
+            ASSERT(root->left->left->left == root + 4, "Compact: vEB keeps small subtrees together");
+
+        // the compacted tree takes ordinary updates
+        for (int i = 0; i < 1000; i++)
+            root = i % 3 ? delete(root, &i, int_compare, int_free) : insert(root, create_int(i), int_compare);
+        ASSERT(getSize(root) == 334 && isValidAVL(root), "Compact: updates after compaction");
+        freeAVLTree(root, int_free);
+    }
+    ASSERT(compactTree(NULL, AVL_LAYOUT_VEB) == NULL, "Compact: empty tree");
+}
+
+TEST(node_arena)
+{
+    AVLArenaStats before, after;
+#ifdef AVL_NODE_ARENA
+    avlArenaStats(&before);
+    AVLNode *root = NULL;
+    for (int i = 0; i < 100000; i++)
+        root = insert(root, create_int(i), int_compare);
+    avlArenaStats(&after);
+    ASSERT(after.nodesInUse - before.nodesInUse == 100000 && after.chunks > 0 &&
+               after.bytes >= after.nodesInUse * sizeof(AVLNode),
+           "Arena: nodes come from arena chunks");
+    ASSERT(after.hugetlbBytes + after.thpBytes + after.fallbackBytes <= after.bytes &&
+               after.hugePageRatio >= 0.0 && after.hugePageRatio <= 1.0,
+           "Arena: huge page share within the arena");
+
+    // released nodes are reused before the arena grows
+    for (int i = 0; i < 100000; i += 2)
+        root = delete(root, &i, int_compare, int_free);
+    for (int i = 0; i < 100000; i += 2)
+        root = insert(root, create_int(i), int_compare);
+    AVLArenaStats reused;
+    avlArenaStats(&reused);
+    ASSERT(reused.chunks == after.chunks && reused.nodesInUse == after.nodesInUse && isValidAVL(root),
+           "Arena: freed nodes reused");
+    freeAVLTree(root, int_free);
+    avlArenaStats(&after);
+    ASSERT(after.nodesInUse == before.nodesInUse, "Arena: freeing the tree releases its nodes");
+#else
+    ASSERT(!avlArenaStats(&before) && before.chunks == 0, "Arena: stats empty when disabled");
+    (void)after;
+#endif
+}
+
+TEST(key_tails)
+{
+    AVLNode *root = NULL;
+    char key[16];
+    resetOpStats();
+    for (int i = 0; i < 500; i++)
+    {
+        int len = snprintf(key, sizeof(key), "key%d", i * 7919 % 500);
+        int value = i * 7919 % 500;
+        root = insertKey(root, key, (size_t)len, &value, sizeof(value));
+    }
+    AVLOpStats s;
+    getOpStats(&s);
+#ifdef AVL_STATS
+    ASSERT(s.allocations == 500, "Key tails: one allocation per insert");
+#endif
+    ASSERT(getSize(root) == 500 && isValidAVL(root) && isValidBST(root, NULL, NULL, avlKeyCompare),
+           "Key tails: tree valid under avlKeyCompare");
+
+    AVLNode *node = searchKey(root, "key123", 6);
+    int value = -1;
+    if (node)
+        memcpy(&value, avlKeyValue(node), sizeof(value));
+    ASSERT(node && node->data == (void *)(node + 1) && value == 123, "Key tails: key and value stored behind the node");
+    ASSERT(!searchKey(root, "key1234", 7) && !searchKey(root, "key", 3), "Key tails: longer and shorter keys differ");
+
+    // a prefix sorts before its extensions
+    root = insertKey(root, "key", 3, NULL, 0);
+    root = insertKey(root, "key", 3, "dup", 3);
+    AVLKey *min = findMin(root)->data;
+    ASSERT(getSize(root) == 501 && min->length == 3 && min->valueLength == 0, "Key tails: prefix first, duplicate ignored");
+
+    for (int i = 0; i < 500; i += 2)
+    {
+        int len = snprintf(key, sizeof(key), "key%d", i);
+        root = deleteKey(root, key, (size_t)len);
+    }
+    root = deleteKey(root, "missing", 7);
+    ASSERT(getSize(root) == 251 && isValidAVL(root) && !searchKey(root, "key2", 4) && searchKey(root, "key3", 4),
+           "Key tails: deletes");
+
+    // relocated nodes take their keys along
+    root = compactTree(root, AVL_LAYOUT_BFS);
+    root = rebuildSubtree(root);
+    root = compactTree(root, AVL_LAYOUT_VEB);
+    node = searchKey(root, "key499", 6);
+    if (node)
+        memcpy(&value, avlKeyValue(node), sizeof(value));
+    ASSERT(node && node->data == (void *)(node + 1) && value == 499 && isValidBST(root, NULL, NULL, avlKeyCompare),
+           "Key tails: keys move with compaction");
+    for (int i = 1; i < 500; i += 2)
+    {
+        int len = snprintf(key, sizeof(key), "key%d", i);
+        root = deleteKey(root, key, (size_t)len);
+    }
+    ASSERT(getSize(root) == 1, "Key tails: compacted nodes delete");
+    AVLTreeStats st;
+    avlStats(root, NULL, &st);
+    AVLKey *last = root->data;
+    ASSERT(st.nodeBytes == sizeof(AVLNode) + sizeof(AVLKey) + last->length + last->valueLength,
+           "Key tails: stats count the tail");
+    freeAVLTree(root, NULL);
+}
+
+// reference order for key_prefixes: memcmp over the shorter length, then the shorter key
+static int naiveKeyCompare(const void *a, const void *b)
+{
+    const AVLKey *x = a, *y = b;
+    size_t common = x->length < y->length ? x->length : y->length;
+    int cmp = common ? memcmp(x->bytes, y->bytes, common) : 0;
+    return cmp ? cmp : (x->length > y->length) - (x->length < y->length);
+}
+
+TEST(key_prefixes)
+{
+    AVLNode *root = insertKey(NULL, "AB", 2, NULL, 0);
+    ASSERT(((AVLKey *)root->data)->prefix == 0x4142000000000000ULL, "Key prefixes: big-endian, zero padded");
+    freeAVLTree(root, NULL);
+
+    // zero bytes tie with the padding, short keys, and keys sharing long prefixes
+    static const char *fixed[] = {"", "\0", "\0\0", "ab", "ab\0", "ab\0\0\0\0\0\0", "ab\0\0\0\0\0\0\0", "abcdefgh",
+                                  "abcdefgh\0", "abcdefghi", "\xff\xff\xff\xff\xff\xff\xff\xff\xff"};
+    static const size_t fixedLength[] = {0, 1, 2, 2, 3, 8, 9, 8, 9, 9, 9};
+    root = NULL;
+    for (int i = 0; i < 11; i++)
+        root = insertKey(root, fixed[i], fixedLength[i], NULL, 0);
+    char key[64];
+    for (int i = 0; i < 400; i++)
+    {
+        int len = snprintf(key, sizeof(key), "https://example.com/a/very/long/path/%d", i * 7919 % 400);
+        root = insertKey(root, key, (size_t)len, NULL, 0);
+    }
+    ASSERT(getSize(root) == 411 && isValidAVL(root) && isValidBST(root, NULL, NULL, naiveKeyCompare),
+           "Key prefixes: order matches memcmp");
+
+    bool found = true;
+    for (int i = 0; i < 11; i++)
+        found = found && searchKey(root, fixed[i], fixedLength[i]);
+    for (int i = 0; i < 400; i += 3)
+    {
+        int len = snprintf(key, sizeof(key), "https://example.com/a/very/long/path/%d", i);
+        found = found && searchKey(root, key, (size_t)len);
+        root = deleteKey(root, key, (size_t)len);
+    }
+    ASSERT(found && !searchKey(root, "ab\0\0", 4) && !searchKey(root, "https://example.com/a/very/long/path/", 37),
+           "Key prefixes: searches");
+    ASSERT(getSize(root) == 277 && isValidAVL(root) && isValidBST(root, NULL, NULL, naiveKeyCompare) &&
+               !searchKey(root, "https://example.com/a/very/long/path/3", 38) &&
+               searchKey(root, "https://example.com/a/very/long/path/4", 38),
+           "Key prefixes: deletes");
+    freeAVLTree(root, NULL);
+}
+
+// payload for key_hints: the key sits in front of bytes that comparisons should not touch
+typedef struct HintedRecord
+{
+    int key;
+    char payload[252];
+} HintedRecord;
+
+static int hintedCompareCalls;
+
+static int hinted_compare(const void *a, const void *b)
+{
+    hintedCompareCalls++;
+    return int_compare(a, b);
+}
+
+// exact hint: keys map to hints one to one
+static unsigned long long hinted_exact(const void *data)
+{
+    return (unsigned long long)*(const int *)data;
+}
+
+// coarse hint: ten keys share each hint, so ties fall back to the comparator
+static unsigned long long hinted_coarse(const void *data)
+{
+    return (unsigned long long)(*(const int *)data / 10);
+}
+
+static void count_callback(const void *data, void *context)
+{
+    (void)data;
+    (*(int *)context)++;
+}
+
+TEST(key_hints)
+{
+    key_hint_func_t hints[] = {hinted_exact, hinted_coarse};
+    for (int h = 0; h < 2; h++)
+    {
+        HintedRecord *records = calloc(1000, sizeof(HintedRecord));
+        AVLNode *root = NULL;
+        for (int i = 0; i < 1000; i++)
+        {
+            records[i].key = i * 7919 % 1000;
+            root = insertHinted(root, &records[i], hinted_compare, hints[h]);
+        }
+        ASSERT(getSize(root) == 1000 && isValidAVL(root) && isValidBST(root, NULL, NULL, int_compare),
+               "Key hints: insert keeps the order");
+
+        hintedCompareCalls = 0;
+        bool found = true;
+        for (int i = 0; i < 1000; i++)
+        {
+            AVLNode *node = searchHinted(root, &i, hinted_compare, hints[h]);
+            found = found && node && ((HintedRecord *)node->data)->key == i;
+        }
+        int missing = 1000;
+        found = found && !searchHinted(root, &missing, hinted_compare, hints[h]);
+#ifdef AVL_KEY_HINTS
+        if (h == 0)
+            ASSERT(found && hintedCompareCalls == 1000, "Key hints: exact hints compare once per hit");
+        else
+            ASSERT(found, "Key hints: coarse hints tie");
+#else
+        ASSERT(found, "Key hints: searches without the flag");
+#endif
+
+        int lo = 95, hi = 304, hinted = 0, plain = 0;
+        rangeQueryHinted(root, &lo, &hi, hinted_compare, hints[h], count_callback, &hinted);
+        rangeQuery(root, &lo, &hi, int_compare, count_callback, &plain);
+        ASSERT(hinted == 210 && plain == 210, "Key hints: range query");
+
+        // deletes need no hints
+        for (int i = 0; i < 1000; i += 2)
+            root = delete(root, &i, int_compare, NULL);
+        ASSERT(getSize(root) == 500 && searchHinted(root, &lo, hinted_compare, hints[h]) &&
+                   !searchHinted(root, &hi, hinted_compare, hints[h]),
+               "Key hints: plain deletes");
+        freeAVLTree(root, NULL);
+        free(records);
+    }
+}
+
+TEST(large_tree_mode)
+{
+#ifdef AVL_PARENT_POINTERS
+    size_t pointers = 4;
+#else
+    size_t pointers = 3;
+#endif
+    size_t counts = 2 * sizeof(int);
+#ifdef AVL_TOMBSTONES
+    counts += sizeof(void *); // the live count, padded to pointer alignment
+#endif
+#ifdef AVL_KEY_HINTS
+    counts += sizeof(unsigned long long);
+#endif
+    ASSERT(sizeof(AVLNode) == pointers * sizeof(void *) + counts, "Large mode: node size unchanged");
+
+    // a root whose left subtree claims more nodes than an int can count
+    int *left_key = create_int(1), *root_key = create_int(2);
+    AVLNode *root = createNode(root_key);
+    root->left = createNode(left_key);
+#ifdef AVL_LARGE_TREE
+    avl_size_t big = (avl_size_t)INT_MAX * 3;
+    root->left->size = big;
+#ifdef AVL_TOMBSTONES
+    root->left->live = big; // rank and kth count live nodes
+#endif
+    root->left->height = 40;
+    updateSize(root);
+    updateHeight(root);
+    ASSERT(getSize(root) == big + 1 && getHeight(root) == 41, "Large mode: 64-bit size and byte height");
+    ASSERT(findKthSmallest(root, big + 1) == root, "Large mode: kth smallest past INT_MAX");
+    ASSERT(getRank(root, root_key, int_compare) == big + 1, "Large mode: rank past INT_MAX");
+    ASSERT(AVL_SIZE_MAX > INT_MAX, "Large mode: size limit above INT_MAX");
+#else
+    updateSize(root);
+    ASSERT(getSize(root) == 2 && AVL_SIZE_MAX == INT_MAX, "Default mode: int sizes");
+#endif
+
+    root->left->left = root->left->right = NULL;
+    freeAVLTree(root, int_free);
+}
+
+static unsigned long long int_hash(const void *data)
+{
+    return (unsigned long long)*(const int *)data;
+}
+
+TEST(op_trace)
+{
+    setTraceKeyHash(int_hash);
+    AVLNode *root = NULL;
+    for (int i = 1; i <= 3; i++)
+        root = insert(root, create_int(i), int_compare);
+    int key = 3;
+    search(root, &key, int_compare);
+    key = 1;
+    root = delete(root, &key, int_compare, int_free);
+
+    AVLTraceEvent events[8];
+    size_t count = traceSnapshot(events, 8);
+#ifdef AVL_TRACE
+    ASSERT(count >= 5, "Trace: events recorded");
+    AVLTraceEvent *last = &events[count - 5];
+    ASSERT(last[2].op == AVL_OP_INSERT && last[2].rotations == 1 && last[2].depth == 2 && last[2].keyHash == 3,
+           "Trace: insert event has depth, rotation count and key hash");
+    ASSERT(last[3].op == AVL_OP_SEARCH && last[3].depth == 2 && last[3].rotations == 0,
+           "Trace: search event recorded");
+    ASSERT(last[4].op == AVL_OP_DELETE && last[4].keyHash == 1 && last[4].seq == last[3].seq + 1,
+           "Trace: delete event follows in sequence");
+    ASSERT(traceSnapshot(events, 2) == 2 && events[1].op == AVL_OP_DELETE, "Trace: snapshot keeps the newest events");
+#else
+    ASSERT(count == 0, "Trace: nothing recorded when disabled");
+#endif
+
+    setTraceKeyHash(NULL);
+    freeAVLTree(root, int_free);
+}
+
+static size_t int_size(const void *data)
+{
+    (void)data;
+    return sizeof(int);
+}
+
+TEST(tree_stats)
+{
+    AVLNode *root = NULL;
+    for (int i = 1; i <= 7; i++)
+        root = insert(root, create_int(i), int_compare);
+
+    AVLTreeStats s;
+    avlStats(root, int_size, &s);
+    ASSERT(s.nodeCount == 7 && s.leafCount == 4, "Stats: node and leaf counts");
+    ASSERT(s.nodeBytes == 7 * sizeof(AVLNode) && s.payloadBytes == 7 * sizeof(int),
+           "Stats: node and payload bytes");
+    ASSERT(s.height == 3 && s.optimalHeight == 3, "Stats: perfect tree has optimal height");
+    ASSERT(s.depthHistogram[0] == 1 && s.depthHistogram[1] == 2 && s.depthHistogram[2] == 4,
+           "Stats: depth histogram");
+    ASSERT(s.totalPathLength == 17, "Stats: total path length");
+    freeAVLTree(root, int_free);
+
+    // parallel and serial results agree on a tree large enough to be split
+    root = NULL;
+    for (int i = 0; i < 200000; i++)
+        root = insert(root, create_int((i * 7919) % 200000), int_compare);
+    AVLTreeStats serial, parallel;
+    avlStats(root, NULL, &serial);
+    avlStatsParallel(root, NULL, &parallel, 4);
+    ASSERT(serial.nodeCount == 200000 && serial.height == getHeight(root), "Stats: serial walk of large tree");
+    ASSERT(memcmp(&serial, &parallel, sizeof(serial)) == 0, "Stats: parallel matches serial");
+    freeAVLTree(root, int_free);
+
+    avlStats(NULL, NULL, &s);
+    ASSERT(s.nodeCount == 0 && s.height == 0, "Stats: empty tree");
+}
+
 // === Test Summary and Main ===
 static void print_summary(void)
 {
@@ -296,6 +1157,26 @@ int main(void)
     RUN_TEST(stress_performance);
     RUN_TEST(utility_functions);
     RUN_TEST(queries);
+    RUN_TEST(op_stats);
+    RUN_TEST(latency_histogram);
+    RUN_TEST(op_trace);
+    RUN_TEST(large_tree_mode);
+    RUN_TEST(buffered_dump);
+    RUN_TEST(visitor_traversal);
+    RUN_TEST(morris_traversal);
+    RUN_TEST(node_handles);
+    RUN_TEST(delete_by_path);
+    RUN_TEST(relaxed_balance);
+    RUN_TEST(weak_avl);
+    RUN_TEST(deferred_rebalance);
+    RUN_TEST(tombstones);
+    RUN_TEST(partial_rebuild);
+    RUN_TEST(compact_tree);
+    RUN_TEST(node_arena);
+    RUN_TEST(key_tails);
+    RUN_TEST(key_prefixes);
+    RUN_TEST(key_hints);
+    RUN_TEST(tree_stats);
 
     // Print final results
     print_summary();